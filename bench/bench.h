@@ -0,0 +1,41 @@
+#ifndef CHANNELSPANNER_BENCH_H
+#define CHANNELSPANNER_BENCH_H
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+
+#include "spanner.h"
+
+/*
+ * Helpers shared by the benchmarks.
+ */
+
+/* values a list option takes at most */
+#define MAX_CONFIGS 16
+
+/* parses a comma separated list of integers into `values`, returns how many there were */
+static inline int parse_list( const char* s, int* values )
+{
+   int n = 0;
+   while ( NULL != s && *s && n < MAX_CONFIGS )
+   {
+      char* end;
+      values[n++] = (int) strtol( s, &end, 10 );
+      s = (',' == *end) ? end + 1 : NULL;
+   }
+   return n;
+}
+
+/* whether plugins are using the Shared Memory, which fake tracks published into it would show up in and closing the
+   last of them would take away */
+static inline int shared_memory_in_use()
+{
+   int fd = shm_open( "/" SHMEMNAME, O_RDONLY, 0 );
+   if ( -1 == fd ) return 0;
+   close( fd );
+   return 1;
+}
+
+#endif //CHANNELSPANNER_BENCH_H
@@ -0,0 +1,351 @@
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glew.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "draw.h"
+#include "resources.h"
+#include "spanner.h"
+#include "perf.h"
+#include "bench.h"
+
+/*
+ * Renders the editor offscreen and reports frame times, so renderer changes can be measured without a host or an
+ * X display. A surfaceless EGL context draws into a framebuffer object, which works with Mesa's llvmpipe.
+ *
+ * Every combination of FFT size and track count is measured on its own. The tracks are fake instances in the Shared
+ * Memory, all in the group of the drawn track, and their spectrums move every frame like they would while playing.
+ */
+
+static int compare( const void* a, const void* b )
+{
+   uint64_t x = *(const uint64_t*) a;
+   uint64_t y = *(const uint64_t*) b;
+   return (x > y) - (x < y);
+}
+
+/* a sloped spectrum with a few resonances that drift with `phase` */
+static void fill_spectrum( float* fft, size_t bins, int seed, float phase )
+{
+   for ( size_t i = 0; i < bins; i++ )
+   {
+      float slope = 0.05f / (1.0f + i * 0.01f);
+      float ripple = 1.0f + 0.5f * sinf( i * 0.004f * (1 + seed % 7) + phase );
+      fft[i] = slope * ripple * (1.0f + 0.1f * seed);
+   }
+}
+
+static EGLDisplay open_display()
+{
+   PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+           (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress( "eglGetPlatformDisplayEXT" );
+
+   EGLDisplay display = (NULL != getPlatformDisplay)
+                        ? getPlatformDisplay( EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL )
+                        : eglGetDisplay( EGL_DEFAULT_DISPLAY );
+
+   if ( EGL_NO_DISPLAY == display || !eglInitialize( display, NULL, NULL ) || !eglBindAPI( EGL_OPENGL_API ) )
+   {
+      fprintf( stderr, "Unable to initialize EGL: %x\n", eglGetError() );
+      return EGL_NO_DISPLAY;
+   }
+
+   return display;
+}
+
+/* a context drawing into a framebuffer of the editor's size, like the one of an editor window */
+static EGLContext create_context( EGLDisplay display, int width, int height )
+{
+   /* the grid and crosshair still use immediate mode, so this needs the compatibility profile */
+   EGLint attributes[] = {
+           EGL_CONTEXT_MAJOR_VERSION, 3,
+           EGL_CONTEXT_MINOR_VERSION, 3,
+           EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+           EGL_NONE
+   };
+
+   EGLContext context = eglCreateContext( display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes );
+   if ( EGL_NO_CONTEXT == context || !eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, context ) )
+   {
+      fprintf( stderr, "Unable to create a GL 3.3 context: %x\n", eglGetError() );
+      return EGL_NO_CONTEXT;
+   }
+
+   glewExperimental = GL_TRUE;
+   glewInit();
+   glGetError();
+
+   GLuint fbo, color;
+   glGenFramebuffers( 1, &fbo );
+   glBindFramebuffer( GL_FRAMEBUFFER, fbo );
+   glGenRenderbuffers( 1, &color );
+   glBindRenderbuffer( GL_RENDERBUFFER, color );
+   glRenderbufferStorage( GL_RENDERBUFFER, GL_RGBA8, width, height );
+   glFramebufferRenderbuffer( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color );
+   if ( GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus( GL_FRAMEBUFFER ) )
+   {
+      fprintf( stderr, "Unable to create a %ix%i framebuffer\n", width, height );
+      eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+      eglDestroyContext( display, context );
+      return EGL_NO_CONTEXT;
+   }
+   glViewport( 0, 0, width, height );
+
+   return context;
+}
+
+/*
+ * Opens and closes the editor `opens` times, every time in a new context like a new editor window gets. An open is
+ * timed from creating the draw context until its first frame is finished, and the first open is reported on its
+ * own, as it's the one filling the process-wide caches.
+ */
+static int measure_opens( EGLDisplay display, int opens, int width, int height, float sampleRate, track_t* track,
+                          shared_memory_t* shmem )
+{
+   uint64_t* times = malloc( (size_t) opens * sizeof( uint64_t ) );
+   uint64_t total = 0;
+
+   /* a plugin instance keeps the shared resources while its editor is closed */
+   acquire_resources();
+
+   for ( int i = 0; i < opens; i++ )
+   {
+      EGLContext context = create_context( display, width, height );
+      if ( EGL_NO_CONTEXT == context )
+      {
+         release_resources();
+         free( times );
+         return 1;
+      }
+
+      uint64_t start = perf_now();
+      draw_ctx_t* ctx = init_draw_ctx( 1, sampleRate );
+      draw( ctx, track, shmem );
+      glFinish();
+      times[i] = perf_now() - start;
+      total += times[i];
+
+      free_draw_ctx( ctx );
+      eglMakeCurrent( display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT );
+      eglDestroyContext( display, context );
+   }
+
+   release_resources();
+
+   uint64_t first = times[0];
+   qsort( times, (size_t) opens, sizeof( uint64_t ), compare );
+
+   printf( "opens,width,height,first_ms,mean_ms,p50_ms,max_ms\n" );
+   printf( "%i,%i,%i,%.3f,%.3f,%.3f,%.3f\n",
+           opens, width, height,
+           first / 1e6,
+           total / 1e6 / opens,
+           times[opens / 2] / 1e6,
+           times[opens - 1] / 1e6 );
+
+   free( times );
+   return 0;
+}
+
+static void usage( const char* name )
+{
+   fprintf( stderr,
+            "Usage: %s [-s WxH] [-f sizes] [-n tracks] [-F frames] [-W warmup] [-r rate] [-o opens] [-U]\n"
+            "  -s WxH     editor size in pixels (default 650x400)\n"
+            "  -f sizes   comma separated FFT sizes (default 1024,4096,16384)\n"
+            "  -n tracks  comma separated counts of other tracks in the group (default 0,8,32)\n"
+            "  -F frames  measured frames per combination (default 200)\n"
+            "  -W warmup  frames drawn before measuring (default 10)\n"
+            "  -r rate    sample rate of every track (default 44100)\n"
+            "  -o opens   measure opening the editor this many times instead of drawing frames\n"
+            "  -U         publish into the Shared Memory even though plugins are using it\n",
+            name );
+}
+
+int main( int argc, char** argv )
+{
+   int width = 650;
+   int height = 400;
+   int sizes[MAX_CONFIGS] = { 1024, 4096, 16384 };
+   int sizeCount = 3;
+   int tracks[MAX_CONFIGS] = { 0, 8, 32 };
+   int trackCount = 3;
+   int frames = 200;
+   int warmup = 10;
+   float sampleRate = 44100.0f;
+   int opens = 0;
+   int force = 0;
+
+   int opt;
+   while ( -1 != (opt = getopt( argc, argv, "s:f:n:F:W:r:o:Uh" )) )
+   {
+      switch ( opt )
+      {
+      case 's':
+         if ( 2 != sscanf( optarg, "%ix%i", &width, &height ) )
+            width = 0;
+         break;
+      case 'f':
+         sizeCount = parse_list( optarg, sizes );
+         break;
+      case 'n':
+         trackCount = parse_list( optarg, tracks );
+         break;
+      case 'F':
+         frames = atoi( optarg );
+         break;
+      case 'W':
+         warmup = atoi( optarg );
+         break;
+      case 'r':
+         sampleRate = strtof( optarg, NULL );
+         break;
+      case 'o':
+         opens = atoi( optarg );
+         break;
+      case 'U':
+         force = 1;
+         break;
+      default:
+         usage( argv[0] );
+         return 1;
+      }
+   }
+
+   if ( width <= 0 || height <= 0 || frames <= 0 || warmup < 0 || sampleRate <= 0 || opens < 0 )
+   {
+      usage( argv[0] );
+      return 1;
+   }
+
+   for ( int i = 0; i < sizeCount; i++ )
+   {
+      if ( sizes[i] < 2 || sizes[i] > MAX_FFT )
+      {
+         fprintf( stderr, "FFT size %i is outside of 2 to %i\n", sizes[i], MAX_FFT );
+         return 1;
+      }
+   }
+
+   if ( !force && shared_memory_in_use() )
+   {
+      fprintf( stderr, "/dev/shm/" SHMEMNAME " exists, close the plugins using it or pass -U\n" );
+      return 1;
+   }
+
+   EGLDisplay display = open_display();
+   if ( EGL_NO_DISPLAY == display )
+      return 1;
+
+   track_t* track = calloc( 1, sizeof( track_t ) );
+   track_t* fake = calloc( 1, sizeof( track_t ) );
+   track->sampleRate = sampleRate;
+   track->group = 1;
+   fake->sampleRate = sampleRate;
+   fake->group = 1;
+
+   shared_memory_t* shmem = open_shared_memory();
+
+   if ( opens > 0 )
+   {
+      track->frameSize = (size_t) sizes[0];
+      int result = measure_opens( display, opens, width, height, sampleRate, track, shmem );
+      close_shared_memory( shmem );
+      free( fake );
+      free( track );
+      eglTerminate( display );
+      return result;
+   }
+
+   EGLContext context = create_context( display, width, height );
+   if ( EGL_NO_CONTEXT == context )
+      return 1;
+
+   fprintf( stderr, "Rendering with %s, %s\n", glGetString( GL_RENDERER ), glGetString( GL_VERSION ) );
+
+   draw_ctx_t* ctx = init_draw_ctx( 1, sampleRate );
+   ctx->width = width;
+   ctx->height = height;
+   set_mouse( ctx, width / 2, height / 2 );
+
+   uint64_t* times = malloc( (size_t) frames * sizeof( uint64_t ) );
+
+   printf( "fft,tracks,width,height,frames,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,draw_calls,vertices\n" );
+
+   for ( int s = 0; s < sizeCount; s++ )
+   {
+      for ( int t = 0; t < trackCount; t++ )
+      {
+         int others = tracks[t];
+         shared_memory_t** instances = calloc( (size_t) others + 1, sizeof( shared_memory_t* ) );
+         for ( int i = 0; i < others; i++ )
+            instances[i] = open_shared_memory();
+
+         track->frameSize = (size_t) sizes[s];
+         fake->frameSize = (size_t) sizes[s];
+         size_t bins = track->frameSize / 2 + 1;
+
+         uint64_t total = 0;
+         for ( int f = -warmup; f < frames; f++ )
+         {
+            /* the spectrums change every frame, outside of the measurement */
+            float phase = f * 0.05f;
+            for ( int ch = 0; ch < MAX_CHANNELS; ch++ )
+               fill_spectrum( track->channels[ch].fft, bins, ch, phase );
+            update_shared_memory( shmem, track );
+
+            for ( int i = 0; i < others; i++ )
+            {
+               fake->color = (uint8_t) (i % 7);
+               for ( int ch = 0; ch < MAX_CHANNELS; ch++ )
+                  fill_spectrum( fake->channels[ch].fft, bins, i + ch + 1, phase );
+               update_shared_memory( instances[i], fake );
+            }
+
+            uint64_t start = perf_now();
+            draw( ctx, track, shmem );
+            glFinish();
+            uint64_t took = perf_now() - start;
+
+            if ( f >= 0 )
+            {
+               times[f] = took;
+               total += took;
+            }
+         }
+
+         GLenum e = glGetError();
+         if ( GL_NO_ERROR != e )
+            fprintf( stderr, "GL error %x with FFT %i and %i tracks\n", e, sizes[s], others );
+
+         qsort( times, (size_t) frames, sizeof( uint64_t ), compare );
+         printf( "%i,%i,%i,%i,%i,%.3f,%.3f,%.3f,%.3f,%.3f,%zu,%zu\n",
+                 sizes[s], others, width, height, frames,
+                 total / 1e6 / frames,
+                 times[frames / 2] / 1e6,
+                 times[(size_t) frames * 90 / 100] / 1e6,
+                 times[(size_t) frames * 99 / 100] / 1e6,
+                 times[frames - 1] / 1e6,
+                 ctx->stats.draw_calls, ctx->stats.vertices );
+         fflush( stdout );
+
+         for ( int i = 0; i < others; i++ )
+            close_shared_memory( instances[i] );
+         free( instances );
+      }
+   }
+
+   free( times );
+   free_draw_ctx( ctx );
+   close_shared_memory( shmem );
+   free( fake );
+   free( track );
+   eglDestroyContext( display, context );
+   eglTerminate( display );
+   return 0;
+}
@@ -0,0 +1,176 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "biquad.h"
+#include "perf.h"
+#include "bench.h"
+
+/*
+ * Measures the band-pass filters, the scalar cascade of each channel against the filter bank that processes every
+ * channel at once, and checks that both produce the same output while the coefficients stay put.
+ *
+ * Both run over the same noise in blocks of each size. Throughput is given in sample frames per second, a frame
+ * being one sample of every channel.
+ */
+
+static void usage( const char* name )
+{
+   fprintf( stderr,
+            "Usage: %s [-b sizes] [-t seconds] [-r rate] [-f freq] [-q q]\n"
+            "  -b sizes    comma separated block sizes in frames (default 32,256,4096)\n"
+            "  -t seconds  seconds of audio filtered per block size (default 60)\n"
+            "  -r rate     sample rate (default 44100)\n"
+            "  -f freq     center frequency in Hz (default 1000)\n"
+            "  -q q        Q of the band-pass (default 3)\n",
+            name );
+}
+
+int main( int argc, char** argv )
+{
+   int blocks[MAX_CONFIGS] = { 32, 256, 4096 };
+   int blockCount = 3;
+   double seconds = 60;
+   float sampleRate = 44100.0f;
+   float freq = 1000.0f;
+   float q = 3.0f;
+
+   int opt;
+   while ( -1 != (opt = getopt( argc, argv, "b:t:r:f:q:h" )) )
+   {
+      switch ( opt )
+      {
+      case 'b':
+         blockCount = parse_list( optarg, blocks );
+         break;
+      case 't':
+         seconds = strtod( optarg, NULL );
+         break;
+      case 'r':
+         sampleRate = strtof( optarg, NULL );
+         break;
+      case 'f':
+         freq = strtof( optarg, NULL );
+         break;
+      case 'q':
+         q = strtof( optarg, NULL );
+         break;
+      default:
+         usage( argv[0] );
+         return 1;
+      }
+   }
+
+   if ( seconds <= 0 || sampleRate <= 0 || freq <= 0 || freq >= sampleRate / 2 || q <= 0 )
+   {
+      usage( argv[0] );
+      return 1;
+   }
+
+   for ( int i = 0; i < blockCount; i++ )
+   {
+      if ( blocks[i] <= 0 )
+      {
+         fprintf( stderr, "Block size %i is not positive\n", blocks[i] );
+         return 1;
+      }
+   }
+
+   size_t frames = (size_t) (seconds * sampleRate);
+   float* input[MAX_CHANNELS];
+   float* scalar[MAX_CHANNELS];
+   float* bank[MAX_CHANNELS];
+   for ( int c = 0; c < MAX_CHANNELS; c++ )
+   {
+      input[c] = malloc( frames * sizeof( float ) );
+      scalar[c] = malloc( frames * sizeof( float ) );
+      bank[c] = malloc( frames * sizeof( float ) );
+      if ( NULL == input[c] || NULL == scalar[c] || NULL == bank[c] )
+      {
+         fprintf( stderr, "Unable to allocate %zu frames\n", frames );
+         return 1;
+      }
+
+      srand( (unsigned) c + 1 );
+      for ( size_t s = 0; s < frames; s++ )
+         input[c][s] = (float) rand() / RAND_MAX * 2 - 1;
+   }
+
+   fprintf( stderr, "Filtering %zu frames of %i channels at %.0f Hz in %i lanes\n",
+            frames, MAX_CHANNELS, sampleRate, BANK_LANES );
+
+   printf( "block,frames,cascade_fps,bank_fps,speedup,max_diff\n" );
+
+   for ( int b = 0; b < blockCount; b++ )
+   {
+      size_t block = (size_t) blocks[b];
+
+      cascade_t cascades[MAX_CHANNELS];
+      memset( cascades, 0, sizeof( cascades ) );
+      for ( int c = 0; c < MAX_CHANNELS; c++ )
+         update_cascade( &cascades[c], freq / sampleRate, q );
+
+      uint64_t start = perf_now();
+      for ( size_t s = 0; s < frames; s += block )
+      {
+         size_t n = (frames - s < block) ? frames - s : block;
+         for ( int c = 0; c < MAX_CHANNELS; c++ )
+            process_cascade( &cascades[c], input[c] + s, scalar[c] + s, n );
+      }
+      uint64_t cascadeTook = perf_now() - start;
+
+      /* a frame of silence takes the bank to its target, so both start from the same coefficients and state */
+      filter_bank_t filters;
+      memset( &filters, 0, sizeof( filters ) );
+      set_filter_bank_target( &filters, freq / sampleRate, q );
+      float silence = 0;
+      const float* silenceIn[MAX_CHANNELS];
+      float* silenceOut[MAX_CHANNELS];
+      for ( int c = 0; c < MAX_CHANNELS; c++ )
+      {
+         silenceIn[c] = &silence;
+         silenceOut[c] = &silence;
+      }
+      process_filter_bank( &filters, silenceIn, silenceOut, MAX_CHANNELS, 1 );
+
+      start = perf_now();
+      for ( size_t s = 0; s < frames; s += block )
+      {
+         size_t n = (frames - s < block) ? frames - s : block;
+         const float* in[MAX_CHANNELS];
+         float* out[MAX_CHANNELS];
+         for ( int c = 0; c < MAX_CHANNELS; c++ )
+         {
+            in[c] = input[c] + s;
+            out[c] = bank[c] + s;
+         }
+         process_filter_bank( &filters, in, out, MAX_CHANNELS, n );
+      }
+      uint64_t bankTook = perf_now() - start;
+
+      double diff = 0;
+      for ( int c = 0; c < MAX_CHANNELS; c++ )
+      {
+         for ( size_t s = 0; s < frames; s++ )
+            diff = fmax( diff, fabs( (double) scalar[c][s] - bank[c][s] ) );
+      }
+
+      printf( "%zu,%zu,%.0f,%.0f,%.2f,%g\n",
+              block, frames,
+              frames / (cascadeTook / 1e9),
+              frames / (bankTook / 1e9),
+              (double) cascadeTook / bankTook,
+              diff );
+      fflush( stdout );
+   }
+
+   for ( int c = 0; c < MAX_CHANNELS; c++ )
+   {
+      free( input[c] );
+      free( scalar[c] );
+      free( bank[c] );
+   }
+   return 0;
+}
@@ -0,0 +1,412 @@
+#include <sys/resource.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <ctime>
+#include <cerrno>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "vst2.h"
+#include "perf.h"
+
+/*
+ * A minimal host: loads the plugin, opens instances and drives processReplacing at the pace of an audio device.
+ *
+ * The main thread plays the audio thread. Every period it processes a block of each instance, with the block size
+ * jittering the way some hosts' do, then sleeps until the next period is due. A period misses its deadline when
+ * processing every instance took longer than the block lasts. Meanwhile a control thread changes parameters and saves
+ * and restores chunks like a host's GUI thread would, so anything that makes the audio thread wait on those shows up
+ * as latency, missed deadlines or page faults.
+ */
+
+#define kVstProcessLevelRealtime 2
+
+typedef AEffect* (* plugin_main_t)( audioMasterCallback );
+
+static float sample_rate = 44100.0f;
+static int max_block = 512;
+static int offline = 0;
+static VstTimeInfo time_info;
+
+static void sleep_until( uint64_t t )
+{
+   struct timespec ts;
+   ts.tv_sec = (time_t) (t / 1000000000ull);
+   ts.tv_nsec = (long) (t % 1000000000ull);
+   while ( EINTR == clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr ) );
+}
+
+static intptr_t host_callback( AEffect* effect, int32_t opcode, int32_t index, intptr_t value, void* ptr, float opt )
+{
+   switch ( opcode )
+   {
+   case audioMasterVersion:
+      return kVstVersion;
+   case audioMasterGetTime:
+      return (intptr_t) &time_info;
+   case audioMasterGetCurrentProcessLevel:
+      return offline ? kVstProcessLevelOffline : kVstProcessLevelRealtime;
+   case audioMasterGetSampleRate:
+      return (intptr_t) sample_rate;
+   case audioMasterGetBlockSize:
+      return max_block;
+   default:
+      return 0;
+   }
+}
+
+struct instance_t
+{
+   AEffect* effect = nullptr;
+   std::vector<std::vector<float>> inputs;
+   std::vector<std::vector<float>> outputs;
+   std::vector<float*> ins;
+   std::vector<float*> outs;
+};
+
+static AEffect* open_instance( plugin_main_t plugin_main )
+{
+   AEffect* effect = plugin_main( host_callback );
+   if ( nullptr == effect || kEffectMagic != effect->magic )
+      return nullptr;
+
+   effect->dispatcher( effect, effOpen, 0, 0, nullptr, 0 );
+   effect->dispatcher( effect, effSetSampleRate, 0, 0, nullptr, sample_rate );
+   effect->dispatcher( effect, effSetBlockSize, 0, max_block, nullptr, 0 );
+   effect->dispatcher( effect, effMainsChanged, 0, 1, nullptr, 0 );
+   effect->dispatcher( effect, effStartProcess, 0, 0, nullptr, 0 );
+   return effect;
+}
+
+static void close_instance( AEffect* effect )
+{
+   effect->dispatcher( effect, effStopProcess, 0, 0, nullptr, 0 );
+   effect->dispatcher( effect, effMainsChanged, 0, 0, nullptr, 0 );
+   effect->dispatcher( effect, effClose, 0, 0, nullptr, 0 );
+}
+
+static void print_stats( const char* measure, std::vector<uint64_t>& ns )
+{
+   if ( ns.empty() )
+   {
+      printf( "%s,0,,,,,,\n", measure );
+      return;
+   }
+
+   std::sort( ns.begin(), ns.end() );
+   double total = 0;
+   for ( auto n : ns )
+      total += n;
+   size_t count = ns.size();
+   printf( "%s,%zu,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", measure, count,
+           total / count / 1e3,
+           ns[count / 2] / 1e3,
+           ns[count * 90 / 100] / 1e3,
+           ns[count * 99 / 100] / 1e3,
+           ns[count * 999 / 1000] / 1e3,
+           ns[count - 1] / 1e3 );
+}
+
+/* changes parameters and saves and restores chunks of random instances until told to stop */
+static void control( std::vector<instance_t>* instances, const std::atomic<int>* running, uint32_t paramMs,
+                     uint32_t chunkMs, std::atomic<uint64_t>* changes, std::atomic<uint64_t>* restores )
+{
+   unsigned seed = 1;
+   uint64_t nextParam = perf_now() + paramMs * 1000000ull;
+   uint64_t nextChunk = perf_now() + chunkMs * 1000000ull;
+   std::vector<uint8_t> chunk;
+
+   while ( running->load() )
+   {
+      uint64_t now = perf_now();
+      AEffect* effect = (*instances)[(size_t) rand_r( &seed ) % instances->size()].effect;
+
+      if ( 0 != paramMs && now >= nextParam )
+      {
+         if ( effect->numParams > 0 )
+         {
+            int index = rand_r( &seed ) % effect->numParams;
+            effect->setParameter( effect, index, (float) rand_r( &seed ) / RAND_MAX );
+            changes->fetch_add( 1 );
+         }
+         nextParam += paramMs * 1000000ull;
+      }
+
+      if ( 0 != chunkMs && now >= nextChunk )
+      {
+         void* data = nullptr;
+         intptr_t size = effect->dispatcher( effect, effGetChunk, 0, 0, &data, 0 );
+         if ( size > 0 && nullptr != data )
+         {
+            chunk.assign( (uint8_t*) data, (uint8_t*) data + size );
+            effect->dispatcher( effect, effSetChunk, 0, (intptr_t) chunk.size(), chunk.data(), 0 );
+            restores->fetch_add( 1 );
+         }
+         nextChunk += chunkMs * 1000000ull;
+      }
+
+      uint64_t next = std::min( 0 != paramMs ? nextParam : UINT64_MAX, 0 != chunkMs ? nextChunk : UINT64_MAX );
+      sleep_until( std::min<uint64_t>( next, perf_now() + 10000000ull ) );
+   }
+}
+
+static void usage( const char* name )
+{
+   fprintf( stderr,
+            "Usage: %s [-p plugin] [-n instances] [-t seconds] [-W seconds] [-r rate] [-B block] [-j jitter]\n"
+            "          [-P ms] [-C ms] [-L cycles] [-o] [-s]\n"
+            "  -p plugin     plugin to load (default bin/ChannelSpanner.so)\n"
+            "  -n instances  instances to process (default 8)\n"
+            "  -t seconds    seconds of audio to play (default 10)\n"
+            "  -W seconds    warm-up left out of the statistics (default 1)\n"
+            "  -r rate       sample rate (default 44100)\n"
+            "  -B block      largest block size (default 512)\n"
+            "  -j jitter     percent of the block size each block may be shorter by (default 50)\n"
+            "  -P ms         change a parameter of a random instance this often, 0 for never (default 200)\n"
+            "  -C ms         save and restore the chunk of a random instance this often, 0 for never (default 1000)\n"
+            "  -L cycles     extra instances opened and closed up front, for lifecycle times (default 8)\n"
+            "  -o            render offline: report the offline process level and don't wait for periods\n"
+            "  -s            strict, fail on any missed deadline or page fault after the warm-up\n",
+            name );
+}
+
+int main( int argc, char** argv )
+{
+   const char* path = "bin/ChannelSpanner.so";
+   int count = 8;
+   double seconds = 10;
+   double warmup = 1;
+   int jitter = 50;
+   uint32_t paramMs = 200;
+   uint32_t chunkMs = 1000;
+   int cycles = 8;
+   int strict = 0;
+
+   int opt;
+   while ( -1 != (opt = getopt( argc, argv, "p:n:t:W:r:B:j:P:C:L:osh" )) )
+   {
+      switch ( opt )
+      {
+      case 'p':
+         path = optarg;
+         break;
+      case 'n':
+         count = atoi( optarg );
+         break;
+      case 't':
+         seconds = strtod( optarg, nullptr );
+         break;
+      case 'W':
+         warmup = strtod( optarg, nullptr );
+         break;
+      case 'r':
+         sample_rate = strtof( optarg, nullptr );
+         break;
+      case 'B':
+         max_block = atoi( optarg );
+         break;
+      case 'j':
+         jitter = atoi( optarg );
+         break;
+      case 'P':
+         paramMs = (uint32_t) strtoul( optarg, nullptr, 10 );
+         break;
+      case 'C':
+         chunkMs = (uint32_t) strtoul( optarg, nullptr, 10 );
+         break;
+      case 'L':
+         cycles = atoi( optarg );
+         break;
+      case 'o':
+         offline = 1;
+         break;
+      case 's':
+         strict = 1;
+         break;
+      default:
+         usage( argv[0] );
+         return 1;
+      }
+   }
+
+   if ( count <= 0 || seconds <= 0 || warmup < 0 || warmup >= seconds || sample_rate <= 0 || max_block <= 0 ||
+        jitter < 0 || jitter > 100 || cycles < 0 )
+   {
+      usage( argv[0] );
+      return 1;
+   }
+
+   void* library = dlopen( path, RTLD_NOW | RTLD_LOCAL );
+   if ( nullptr == library )
+   {
+      fprintf( stderr, "Unable to load %s: %s\n", path, dlerror() );
+      return 1;
+   }
+
+   auto plugin_main = (plugin_main_t) dlsym( library, "VSTPluginMain" );
+   if ( nullptr == plugin_main )
+   {
+      fprintf( stderr, "%s has no VSTPluginMain\n", path );
+      dlclose( library );
+      return 1;
+   }
+
+   time_info.sampleRate = sample_rate;
+   time_info.flags = kVstTransportPlaying;
+
+   std::vector<uint64_t> opens;
+   std::vector<uint64_t> closes;
+
+   /* the first instance of a process sets up what the others share, so the cycles are timed on top of one */
+   std::vector<instance_t> instances( (size_t) count );
+   for ( int i = 0; i < count + cycles; i++ )
+   {
+      uint64_t start = perf_now();
+      AEffect* effect = open_instance( plugin_main );
+      opens.push_back( perf_now() - start );
+      if ( nullptr == effect )
+      {
+         fprintf( stderr, "Unable to open an instance of %s\n", path );
+         return 1;
+      }
+
+      if ( i < count )
+      {
+         instances[(size_t) i].effect = effect;
+         continue;
+      }
+
+      start = perf_now();
+      close_instance( effect );
+      closes.push_back( perf_now() - start );
+   }
+
+   unsigned seed = 7;
+   for ( auto& in : instances )
+   {
+      int channels = std::max( in.effect->numInputs, in.effect->numOutputs );
+      in.inputs.assign( (size_t) channels, std::vector<float>( (size_t) max_block ) );
+      in.outputs.assign( (size_t) channels, std::vector<float>( (size_t) max_block ) );
+      for ( int c = 0; c < channels; c++ )
+      {
+         in.ins.push_back( in.inputs[(size_t) c].data() );
+         in.outs.push_back( in.outputs[(size_t) c].data() );
+      }
+   }
+
+   std::atomic<int> running( 1 );
+   std::atomic<uint64_t> changes( 0 );
+   std::atomic<uint64_t> restores( 0 );
+   std::thread controller( control, &instances, &running, paramMs, chunkMs, &changes, &restores );
+
+   /* like a host's audio thread, when the system lets us */
+   struct sched_param sp;
+   sp.sched_priority = sched_get_priority_min( SCHED_FIFO ) + 10;
+   if ( !offline && 0 != pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp ) )
+      fprintf( stderr, "Unable to make the audio thread real-time, expect more missed deadlines\n" );
+
+   fprintf( stderr, "Playing %.1f s through %i instances at %.0f Hz in blocks of up to %i samples%s\n",
+            seconds, count, sample_rate, max_block, offline ? ", offline" : "" );
+
+   std::vector<uint64_t> calls;
+   std::vector<uint64_t> periods;
+   uint64_t misses = 0;
+   long minorFaults = 0;
+   long majorFaults = 0;
+   uint64_t samples = 0;
+   uint64_t total = (uint64_t) (seconds * sample_rate);
+   uint64_t warm = (uint64_t) (warmup * sample_rate);
+   uint64_t due = perf_now();
+   uint64_t phase = 0;
+
+   /* growing a vector allocates and faults, so samples only land in them outside the measured window and never
+      make them grow */
+   size_t shortest = (size_t) std::max( 1, max_block - max_block * jitter / 100 );
+   periods.reserve( (size_t) (total / shortest + 1) );
+   calls.reserve( periods.capacity() * instances.size() );
+   std::vector<uint64_t> took( instances.size() );
+
+   while ( samples < total )
+   {
+      int block = max_block - (0 == jitter ? 0 : rand_r( &seed ) % (max_block * jitter / 100 + 1));
+      if ( block <= 0 ) block = 1;
+
+      /* a tone and some noise, different on every channel */
+      for ( auto& in : instances )
+      {
+         for ( size_t c = 0; c < in.inputs.size(); c++ )
+            for ( int s = 0; s < block; s++ )
+               in.inputs[c][(size_t) s] = 0.5f * sinf( (float) (phase + (uint64_t) s) * 0.031f * (float) (c + 1) ) +
+                                          0.05f * ((float) rand_r( &seed ) / RAND_MAX - 0.5f);
+      }
+
+      int measured = samples >= warm;
+      struct rusage before, after;
+      getrusage( RUSAGE_THREAD, &before );
+
+      uint64_t start = perf_now();
+      for ( size_t i = 0; i < instances.size(); i++ )
+      {
+         uint64_t t = perf_now();
+         instances[i].effect->processReplacing( instances[i].effect, instances[i].ins.data(),
+                                                instances[i].outs.data(), block );
+         took[i] = perf_now() - t;
+      }
+      uint64_t period = perf_now() - start;
+
+      getrusage( RUSAGE_THREAD, &after );
+
+      uint64_t deadline = (uint64_t) (block * 1e9 / sample_rate);
+      if ( measured )
+      {
+         calls.insert( calls.end(), took.begin(), took.end() );
+         periods.push_back( period );
+         misses += period > deadline;
+         minorFaults += after.ru_minflt - before.ru_minflt;
+         majorFaults += after.ru_majflt - before.ru_majflt;
+      }
+
+      samples += (uint64_t) block;
+      phase += (uint64_t) block;
+      time_info.samplePos = (double) samples;
+
+      due += deadline;
+      if ( !offline )
+         sleep_until( due );
+   }
+
+   running.store( 0 );
+   controller.join();
+
+   for ( auto& in : instances )
+   {
+      uint64_t start = perf_now();
+      close_instance( in.effect );
+      closes.push_back( perf_now() - start );
+   }
+
+   printf( "measure,count,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n" );
+   print_stats( "process", calls );
+   print_stats( "period", periods );
+   print_stats( "open", opens );
+   print_stats( "close", closes );
+
+   fprintf( stderr, "Missed %lu of %zu deadlines, %ld minor and %ld major page faults on the audio thread after the "
+                    "warm-up, %lu parameter changes, %lu chunks restored\n",
+            (unsigned long) misses, periods.size(), minorFaults, majorFaults,
+            (unsigned long) changes.load(), (unsigned long) restores.load() );
+
+   dlclose( library );
+
+   if ( strict && (0 != misses || 0 != minorFaults || 0 != majorFaults) )
+      return 2;
+   return 0;
+}
@@ -0,0 +1,438 @@
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "process.h"
+#include "spanner.h"
+#include "biquad.h"
+#include "draw.h"
+#include "perf.h"
+#include "bench.h"
+
+/*
+ * Micro-benchmarks of the analysis, publishing and per-frame drawing paths, none of which need a host or a GL context.
+ *
+ * Every benchmark runs for each combination of the parameters it depends on, and is repeated in growing batches until
+ * it ran for at least the minimum time. One CSV row is printed per combination, so results of two builds can be
+ * joined on the parameter columns and compared.
+ */
+
+typedef struct {
+   size_t frameSize;
+   size_t block;
+   int channels;
+   int instances;
+
+   track_t* track;
+   track_t** tracks;
+   shared_memory_t** shmems;
+   float* samples[MAX_CHANNELS];
+   float* out[MAX_CHANNELS]; /* filtering in place would decay the input into denormals */
+   cascade_t cascades[MAX_CHANNELS];
+   filter_bank_t bank;
+   draw_ctx_t* ctx;
+   bin_map_t map;
+   uint64_t now;
+   int next;
+} bench_t;
+
+typedef void (* bench_fn)( bench_t* b );
+
+/* the clock the Shared Memory's publication times are taken from */
+static uint64_t raw_now()
+{
+   struct timespec cl;
+   clock_gettime( CLOCK_MONOTONIC_RAW, &cl );
+   return (uint64_t) cl.tv_sec * 1000000000ull + (uint64_t) cl.tv_nsec;
+}
+
+static void fill( float* samples, size_t count, const char* input, size_t offset )
+{
+   for ( size_t i = 0; i < count; i++ )
+   {
+      if ( 0 == strcmp( input, "noise" ) )
+         samples[i] = (float) rand() / RAND_MAX * 2 - 1;
+      else if ( 0 == strcmp( input, "tonal" ) )
+         samples[i] = 0.5f * sinf( (float) (offset + i) * 0.0712f ) + 0.25f * sinf( (float) (offset + i) * 0.3301f );
+      else
+         samples[i] = 0;
+   }
+}
+
+/* runs `fn` in doubling batches until a batch took at least `minNs`, returns ns per call */
+static double measure( bench_fn fn, bench_t* b, uint64_t minNs, uint64_t* calls )
+{
+   for ( uint64_t batch = 1;; batch *= 2 )
+   {
+      uint64_t start = perf_now();
+      for ( uint64_t i = 0; i < batch; i++ )
+         fn( b );
+      uint64_t took = perf_now() - start;
+
+      if ( took >= minNs || batch >= (1ull << 40) )
+      {
+         *calls = batch;
+         return (double) took / batch;
+      }
+   }
+}
+
+static void print_row( const char* name, const char* variant, const bench_t* b, uint64_t calls, double ns,
+                       double items, const char* unit )
+{
+   printf( "%s,%s,%zu,%zu,%i,%i,%lu,%.1f,%.0f,%s\n",
+           name, variant, b->frameSize, b->block, b->channels, b->instances,
+           (unsigned long) calls, ns, items * 1e9 / ns, unit );
+   fflush( stdout );
+}
+
+static void bench_add_sample_data( bench_t* b )
+{
+   for ( int c = 0; c < b->channels; c++ )
+      add_sample_data( b->track, (size_t) c, b->samples[c], b->block );
+}
+
+static void bench_process_samples( bench_t* b )
+{
+   process_samples( b->track, 0.25f );
+}
+
+/* each call publishes the next instance, so every slot's pages take their turn */
+static void bench_update_shared_memory( bench_t* b )
+{
+   update_shared_memory( b->shmems[b->next], b->tracks[b->next] );
+   b->next = (b->next + 1) % b->instances;
+}
+
+static void bench_find_shared_memory_slot( bench_t* b )
+{
+   (void) find_shared_memory_slot( b->shmems[b->next] );
+   b->next = (b->next + 1) % b->instances;
+}
+
+static void bench_process_cascade( bench_t* b )
+{
+   for ( int c = 0; c < b->channels; c++ )
+      process_cascade( &b->cascades[c], b->samples[c], b->out[c], b->block );
+}
+
+static void bench_process_filter_bank( bench_t* b )
+{
+   process_filter_bank( &b->bank, (const float* const*) b->samples, b->out, (size_t) b->channels, b->block );
+}
+
+static void bench_map_bins( bench_t* b )
+{
+   map_bins( b->ctx, &b->map, 44100.0f, b->frameSize );
+}
+
+/* what a frame of the editor does on the CPU for every other track before its lines are uploaded */
+static void bench_interpolate_history( bench_t* b )
+{
+   for ( int t = next_group_member( b->shmems[0], 1, -1 ); -1 != t; t = next_group_member( b->shmems[0], 1, t ) )
+   {
+      spectrum_history_t* h = update_history( b->ctx, b->shmems[0], t );
+      if ( NULL == h ) continue;
+      for ( int ch = 0; ch < MAX_CHANNELS; ch++ )
+         (void) interpolate_history( b->ctx, h, ch, b->now );
+   }
+}
+
+static track_t* new_track( size_t frameSize, const char* input )
+{
+   track_t* t = init_sample_data( frameSize );
+   float* samples = malloc( frameSize * sizeof( float ) );
+   for ( int c = 0; c < MAX_CHANNELS; c++ )
+   {
+      fill( samples, frameSize, input, (size_t) c * 977 );
+      add_sample_data( t, (size_t) c, samples, frameSize );
+   }
+   free( samples );
+   process_samples( t, 1.0f );
+   return t;
+}
+
+static void open_instances( bench_t* b, size_t frameSize )
+{
+   b->tracks = calloc( (size_t) b->instances, sizeof( track_t* ) );
+   b->shmems = calloc( (size_t) b->instances, sizeof( shared_memory_t* ) );
+   for ( int i = 0; i < b->instances; i++ )
+   {
+      b->tracks[i] = new_track( frameSize, "noise" );
+      b->shmems[i] = open_shared_memory();
+      update_shared_memory( b->shmems[i], b->tracks[i] );
+   }
+   b->next = 0;
+}
+
+static void close_instances( bench_t* b )
+{
+   for ( int i = 0; i < b->instances; i++ )
+   {
+      close_shared_memory( b->shmems[i] );
+      free_sample_data( b->tracks[i] );
+   }
+   free( b->shmems );
+   free( b->tracks );
+}
+
+static int selected( const char* only, const char* name )
+{
+   return NULL == only || NULL != strstr( only, name );
+}
+
+static void usage( const char* name )
+{
+   fprintf( stderr,
+            "Usage: %s [-f sizes] [-B blocks] [-c channels] [-n instances] [-t ms] [-b benchmarks] [-F]\n"
+            "  -f sizes       comma separated FFT sizes (default: every power of 2 from 256 to %i)\n"
+            "  -B blocks      comma separated host block sizes (default 64,256,1024)\n"
+            "  -c channels    comma separated channel counts up to %i (default: 1 to %i)\n"
+            "  -n instances   comma separated instance counts (default 1,8,32)\n"
+            "  -t ms          minimum time of each measurement (default 100)\n"
+            "  -b benchmarks  only run those whose names are in this comma separated list\n"
+            "  -F             publish into the Shared Memory even though plugins are using it\n",
+            name, MAX_FFT, MAX_CHANNELS, MAX_CHANNELS );
+}
+
+int main( int argc, char** argv )
+{
+   int sizes[MAX_CONFIGS];
+   int sizeCount = 0;
+   for ( int s = 256; s <= MAX_FFT && sizeCount < MAX_CONFIGS; s *= 2 )
+      sizes[sizeCount++] = s;
+   int blocks[MAX_CONFIGS] = { 64, 256, 1024 };
+   int blockCount = 3;
+   int channels[MAX_CONFIGS];
+   int channelCount = 0;
+   for ( int c = 1; c <= MAX_CHANNELS && channelCount < MAX_CONFIGS; c++ )
+      channels[channelCount++] = c;
+   int instances[MAX_CONFIGS] = { 1, 8, 32 };
+   int instanceCount = 3;
+   uint64_t minNs = 100000000ull;
+   const char* only = NULL;
+   int force = 0;
+
+   int opt;
+   while ( -1 != (opt = getopt( argc, argv, "f:B:c:n:t:b:Fh" )) )
+   {
+      switch ( opt )
+      {
+      case 'f':
+         sizeCount = parse_list( optarg, sizes );
+         break;
+      case 'B':
+         blockCount = parse_list( optarg, blocks );
+         break;
+      case 'c':
+         channelCount = parse_list( optarg, channels );
+         break;
+      case 'n':
+         instanceCount = parse_list( optarg, instances );
+         break;
+      case 't':
+         minNs = strtoull( optarg, NULL, 10 ) * 1000000ull;
+         break;
+      case 'b':
+         only = optarg;
+         break;
+      case 'F':
+         force = 1;
+         break;
+      default:
+         usage( argv[0] );
+         return 1;
+      }
+   }
+
+   int valid = minNs > 0;
+   for ( int i = 0; i < sizeCount; i++ )
+      valid &= sizes[i] >= 256 && sizes[i] <= MAX_FFT && 0 == (sizes[i] & (sizes[i] - 1));
+   for ( int i = 0; i < blockCount; i++ )
+      valid &= blocks[i] > 0 && blocks[i] <= MAX_FFT;
+   for ( int i = 0; i < channelCount; i++ )
+      valid &= channels[i] > 0 && channels[i] <= MAX_CHANNELS;
+   for ( int i = 0; i < instanceCount; i++ )
+      valid &= instances[i] > 0 && instances[i] <= MAX_SLOTS;
+   if ( !valid )
+   {
+      usage( argv[0] );
+      return 1;
+   }
+
+   int publishes = selected( only, "update_shared_memory" ) || selected( only, "find_shared_memory_slot" ) ||
+                   selected( only, "interpolate_history" );
+   if ( publishes && !force && shared_memory_in_use() )
+   {
+      fprintf( stderr, "/dev/shm/" SHMEMNAME " exists, close the plugins using it, pass -F or leave out the "
+                       "benchmarks that publish with -b\n" );
+      return 1;
+   }
+
+   bench_t b;
+   memset( &b, 0, sizeof( b ) );
+   uint64_t calls;
+   double ns;
+
+   int maxBlock = 0;
+   for ( int i = 0; i < blockCount; i++ )
+      maxBlock = (blocks[i] > maxBlock) ? blocks[i] : maxBlock;
+   for ( int c = 0; c < MAX_CHANNELS; c++ )
+   {
+      b.samples[c] = malloc( (size_t) maxBlock * sizeof( float ) );
+      b.out[c] = malloc( (size_t) maxBlock * sizeof( float ) );
+   }
+
+   printf( "benchmark,variant,fft,block,channels,instances,calls,ns_per_call,throughput,unit\n" );
+
+   if ( selected( only, "add_sample_data" ) )
+   {
+      for ( int s = 0; s < sizeCount; s++ )
+         for ( int k = 0; k < blockCount; k++ )
+            for ( int c = 0; c < channelCount; c++ )
+            {
+               /* a block longer than the frame would wrap around the ring more than once */
+               if ( blocks[k] > sizes[s] ) continue;
+
+               b.frameSize = (size_t) sizes[s];
+               b.block = (size_t) blocks[k];
+               b.channels = channels[c];
+               b.instances = 1;
+               for ( int ch = 0; ch < MAX_CHANNELS; ch++ )
+                  fill( b.samples[ch], b.block, "noise", 0 );
+               b.track = init_sample_data( b.frameSize );
+               ns = measure( bench_add_sample_data, &b, minNs, &calls );
+               print_row( "add_sample_data", "noise", &b, calls, ns, (double) b.block, "frames/s" );
+               free_sample_data( b.track );
+            }
+   }
+
+   if ( selected( only, "process_samples" ) )
+   {
+      const char* inputs[] = { "silent", "noise", "tonal" };
+      for ( int s = 0; s < sizeCount; s++ )
+         for ( int i = 0; i < 3; i++ )
+         {
+            b.frameSize = (size_t) sizes[s];
+            b.block = 0;
+            b.channels = MAX_CHANNELS;
+            b.instances = 1;
+            b.track = new_track( b.frameSize, inputs[i] );
+            ns = measure( bench_process_samples, &b, minNs, &calls );
+            print_row( "process_samples", inputs[i], &b, calls, ns, (double) b.frameSize, "samples/s" );
+            free_sample_data( b.track );
+         }
+   }
+
+   if ( selected( only, "update_shared_memory" ) || selected( only, "find_shared_memory_slot" ) )
+   {
+      for ( int n = 0; n < instanceCount; n++ )
+      {
+         b.frameSize = MAX_FFT;
+         b.block = 0;
+         b.channels = MAX_CHANNELS;
+         b.instances = instances[n];
+         open_instances( &b, b.frameSize );
+
+         if ( selected( only, "update_shared_memory" ) )
+         {
+            ns = measure( bench_update_shared_memory, &b, minNs, &calls );
+            print_row( "update_shared_memory", "copy", &b, calls, ns, 1, "updates/s" );
+         }
+         if ( selected( only, "find_shared_memory_slot" ) )
+         {
+            ns = measure( bench_find_shared_memory_slot, &b, minNs, &calls );
+            print_row( "find_shared_memory_slot", "cached", &b, calls, ns, 1, "lookups/s" );
+         }
+
+         close_instances( &b );
+      }
+   }
+
+   if ( selected( only, "process_cascade" ) || selected( only, "process_filter_bank" ) )
+   {
+      for ( int k = 0; k < blockCount; k++ )
+         for ( int c = 0; c < channelCount; c++ )
+         {
+            b.frameSize = 0;
+            b.block = (size_t) blocks[k];
+            b.channels = channels[c];
+            b.instances = 1;
+            for ( int ch = 0; ch < MAX_CHANNELS; ch++ )
+            {
+               fill( b.samples[ch], b.block, "noise", 0 );
+               update_cascade( &b.cascades[ch], 1000.0f / 44100.0f, 3.0f );
+            }
+
+            if ( selected( only, "process_cascade" ) )
+            {
+               ns = measure( bench_process_cascade, &b, minNs, &calls );
+               print_row( "process_cascade", "scalar", &b, calls, ns, (double) b.block, "frames/s" );
+            }
+            if ( selected( only, "process_filter_bank" ) )
+            {
+               memset( &b.bank, 0, sizeof( b.bank ) );
+               set_filter_bank_target( &b.bank, 1000.0f / 44100.0f, 3.0f );
+               ns = measure( bench_process_filter_bank, &b, minNs, &calls );
+               print_row( "process_filter_bank", "lanes", &b, calls, ns, (double) b.block, "frames/s" );
+            }
+         }
+   }
+
+   if ( selected( only, "map_bins" ) || selected( only, "interpolate_history" ) )
+   {
+      b.ctx = init_draw_ctx( 1, 44100.0f );
+      resize_draw_ctx( b.ctx, 1, 650, 400 );
+
+      for ( int s = 0; s < sizeCount; s++ )
+      {
+         b.frameSize = (size_t) sizes[s];
+         b.block = 0;
+         b.channels = MAX_CHANNELS;
+         b.instances = 1;
+
+         if ( selected( only, "map_bins" ) )
+         {
+            memset( &b.map, 0, sizeof( b.map ) );
+            ns = measure( bench_map_bins, &b, minNs, &calls );
+            print_row( "map_bins", "650px", &b, calls, ns, (double) (b.frameSize / 2 + 1), "bins/s" );
+            free( b.map.bins );
+         }
+
+         if ( selected( only, "interpolate_history" ) )
+         {
+            for ( int n = 0; n < instanceCount; n++ )
+            {
+               b.instances = instances[n];
+               open_instances( &b, b.frameSize );
+
+               /* every track published twice a few ms apart, and is drawn somewhere between the two */
+               bench_interpolate_history( &b );
+               struct timespec pause = { 0, 5000000 };
+               nanosleep( &pause, NULL );
+               for ( int i = 0; i < b.instances; i++ )
+                  update_shared_memory( b.shmems[i], b.tracks[i] );
+               b.now = raw_now();
+               bench_interpolate_history( &b );
+
+               ns = measure( bench_interpolate_history, &b, minNs, &calls );
+               print_row( "interpolate_history", "blend", &b, calls, ns,
+                          (double) b.instances * MAX_CHANNELS * (b.frameSize / 2 + 1), "bins/s" );
+               close_instances( &b );
+            }
+         }
+      }
+
+      free_draw_ctx( b.ctx );
+   }
+
+   for ( int c = 0; c < MAX_CHANNELS; c++ )
+   {
+      free( b.samples[c] );
+      free( b.out[c] );
+   }
+   return 0;
+}
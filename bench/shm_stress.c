@@ -0,0 +1,585 @@
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "process.h"
+#include "spanner.h"
+#include "perf.h"
+
+/*
+ * Stress of the Shared Memory from several processes at once, the way a host that sandboxes plugins uses it.
+ *
+ * Each process runs a number of users, each one what a plugin instance holds, and picks one at random over and over to
+ * open, close, publish a track or read every track of its group as the editor would. All processes stop together every
+ * so often while one of them checks the Shared Memory against what the users believe they own: that the user count is
+ * right, that no slot is claimed twice, that no claimed slot went missing or was left behind and that only live slots
+ * are members of a group, of one group only. Now and then a user goes idle for longer than OLD_UPDATE, like a plugin
+ * the host stopped processing, so its slot is taken away while it stays open. Then it is closed or publishes again.
+ * Latencies are sampled per operation and printed as CSV.
+ *
+ * The processes are forked, so `perf stat` counts all of them, e.g. `perf stat -e cache-misses,cache-references` or
+ * `perf c2c record` around a run shows how much the slots' and groups' cache lines bounce between cores.
+ */
+
+#define MAX_PROCESSES 64
+#define SAMPLE_CAP 16384 /* latency samples kept per operation and process */
+#define IDLE_NS ((OLD_UPDATE + 2) * 1000000000ull) /* long enough for the slot to be taken away */
+#define IDLE_ODDS 4096 /* one in this many publishes goes idle, while fewer than the idle users are */
+#define IDLE_OWNER 0x80000000u /* an owner whose slot may be taken away */
+
+enum
+{
+   OPEN, CLAIM, PUBLISH, READ, CLOSE, MEASURES
+};
+
+static const char* measureNames[MEASURES] = { "open", "claim", "publish", "read", "close" };
+
+typedef struct {
+   uint64_t count;
+   uint64_t total; /* ns */
+   uint32_t kept;
+   uint64_t samples[SAMPLE_CAP]; /* a uniform sample of every call, ns */
+} measure_t;
+
+typedef struct {
+   measure_t measures[MEASURES];
+   uint64_t tracksRead;
+   uint64_t duplicates; /* claimed a slot another user owned */
+   uint64_t moved;      /* a publish found its slot taken and claimed another, while it was not idle */
+   uint64_t idled;      /* times a user went idle */
+   uint64_t failed;     /* no Shared Memory or no slot left */
+} results_t;
+
+/* shared by every process, mapped before forking */
+typedef struct {
+   pthread_barrier_t barrier;
+   uint64_t start;
+   uint64_t open;              /* users across every process that hold the Shared Memory */
+   uint32_t owners[MAX_SLOTS]; /* which user claimed a slot, 0 for none, with IDLE_OWNER while it is idle */
+   uint64_t checks;
+   uint64_t users;   /* checks where the user count was off */
+   uint64_t missing; /* slots a user owns that the Shared Memory lost */
+   uint64_t orphans; /* claimed slots that no user owns */
+   uint64_t ghosts;  /* unclaimed slots still in a group, or slots in more than one */
+   results_t results[];
+} board_t;
+
+typedef struct {
+   int processes;
+   int users;
+   double seconds;
+   uint32_t checkMs;
+   int churn;
+   int reads;
+   int groups;
+   int idle;
+   size_t frameSize;
+   int pin;
+} config_t;
+
+static void record( results_t* r, int measure, uint64_t ns, unsigned* seed )
+{
+   measure_t* m = &r->measures[measure];
+   m->count++;
+   m->total += ns;
+
+   if ( m->kept < SAMPLE_CAP )
+   {
+      m->samples[m->kept++] = ns;
+   }
+   else
+   {
+      uint64_t i = (((uint64_t) rand_r( seed ) << 31) | (uint64_t) rand_r( seed )) % m->count;
+      if ( i < SAMPLE_CAP )
+         m->samples[i] = ns;
+   }
+}
+
+/* compares the Shared Memory against the owners, while every process waits */
+static void check( board_t* board )
+{
+   board->checks++;
+
+   int fd = shm_open( "/" SHMEMNAME, O_RDONLY, 0 );
+   if ( -1 == fd )
+   {
+      board->users += 0 != board->open;
+      for ( int i = 0; i < MAX_SLOTS; i++ )
+         board->missing += 0 != board->owners[i];
+      return;
+   }
+
+   spanner_t* spanner = mmap( NULL, sizeof( spanner_t ), PROT_READ, MAP_SHARED, fd, 0 );
+   close( fd );
+   if ( MAP_FAILED == spanner )
+   {
+      fprintf( stderr, "Unable to map the Shared Memory: %s\n", strerror( errno ) );
+      return;
+   }
+
+   board->users += __atomic_load_n( &spanner->users, __ATOMIC_ACQUIRE ) != board->open;
+
+   for ( int i = 0; i < MAX_SLOTS; i++ )
+   {
+      long id = __atomic_load_n( &spanner->slots[i].id, __ATOMIC_ACQUIRE );
+      board->missing += 0 != board->owners[i] && 0 == (board->owners[i] & IDLE_OWNER) && 0 == id;
+      board->orphans += 0 == board->owners[i] && 0 != id;
+
+      int groups = 0;
+      for ( int g = 0; g <= MAX_INSTANCES; g++ )
+         groups += 0 != (__atomic_load_n( &spanner->members[g][i / 64], __ATOMIC_ACQUIRE ) & (1ull << (i % 64)));
+      board->ghosts += (0 == id && groups > 0) || groups > 1;
+   }
+
+   munmap( spanner, sizeof( spanner_t ) );
+}
+
+/* every process waits for the others, one of them checks, then all carry on */
+static void pause_all( board_t* board )
+{
+   if ( PTHREAD_BARRIER_SERIAL_THREAD == pthread_barrier_wait( &board->barrier ) )
+      check( board );
+   pthread_barrier_wait( &board->barrier );
+}
+
+/* an idle owner may have lost the slot, to this claimant or to its own return */
+static void own( board_t* board, results_t* r, int slot, uint32_t token )
+{
+   if ( -1 == slot ) return;
+
+   uint32_t owner = 0;
+   if ( !__atomic_compare_exchange_n( &board->owners[slot], &owner, token, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) &&
+        (0 == (owner & IDLE_OWNER) ||
+         !__atomic_compare_exchange_n( &board->owners[slot], &owner, token, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED )) )
+      r->duplicates++;
+}
+
+static void disown( board_t* board, int slot, uint32_t token )
+{
+   if ( -1 != slot )
+      __atomic_compare_exchange_n( &board->owners[slot], &token, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED );
+}
+
+static void stress( board_t* board, const config_t* cfg, int p )
+{
+   results_t* r = &board->results[p];
+   unsigned seed = (unsigned) (p + 1) * 2654435761u ^ (unsigned) getpid();
+
+   shared_memory_t* shmems[MAX_SLOTS] = { NULL };
+   track_t* tracks[MAX_SLOTS];
+   int slots[MAX_SLOTS];
+   uint64_t idleUntil[MAX_SLOTS]; /* ns, 0 while the user is active */
+   int idling = 0;
+
+   for ( int k = 0; k < cfg->users; k++ )
+   {
+      tracks[k] = init_sample_data( cfg->frameSize );
+      tracks[k]->group = (uint8_t) (1 + (p * cfg->users + k) % cfg->groups);
+      tracks[k]->color = (uint8_t) k;
+      for ( int c = 0; c < MAX_CHANNELS; c++ )
+         for ( size_t s = 0; s < MAX_FFT / 2 + 1; s++ )
+            tracks[k]->channels[c].fft[s] = (float) (p + k + c);
+      slots[k] = -1;
+      idleUntil[k] = 0;
+   }
+
+   /* the start is taken after everyone forked and set up, so the checks line up across processes */
+   if ( PTHREAD_BARRIER_SERIAL_THREAD == pthread_barrier_wait( &board->barrier ) )
+      board->start = perf_now();
+   pthread_barrier_wait( &board->barrier );
+
+   uint64_t start = board->start;
+   uint64_t end = start + (uint64_t) (cfg->seconds * 1e9);
+   uint64_t interval = cfg->checkMs * 1000000ull;
+   uint64_t checks = 0 == interval ? 0 : (end - start) / interval;
+   volatile float sink = 0;
+
+   for ( uint64_t done = 0;; )
+   {
+      uint64_t now = perf_now();
+      if ( done < checks && now >= start + (done + 1) * interval )
+      {
+         pause_all( board );
+         done++;
+         continue;
+      }
+      if ( now >= end ) break;
+
+      int k = rand_r( &seed ) % cfg->users;
+      int roll = rand_r( &seed ) % 100;
+      uint32_t token = (uint32_t) p << 16 | (uint32_t) (k + 1);
+
+      /* an idle user is left alone until its time is up, then it is either closed or publishes again */
+      int idle = 0 != idleUntil[k];
+      if ( idle )
+      {
+         if ( now < idleUntil[k] ) continue;
+         token |= IDLE_OWNER;
+         roll = rand_r( &seed ) % 2 ? -1 : 100;
+      }
+
+      if ( NULL == shmems[k] )
+      {
+         uint64_t t = perf_now();
+         shared_memory_t* shmem = open_shared_memory();
+         record( r, OPEN, perf_now() - t, &seed );
+
+         if ( NULL == get_shared_memory_slot( shmem, 0 ) )
+         {
+            r->failed++;
+            close_shared_memory( shmem );
+            continue;
+         }
+         shmems[k] = shmem;
+         __atomic_add_fetch( &board->open, 1, __ATOMIC_ACQ_REL );
+
+         t = perf_now();
+         slots[k] = find_shared_memory_slot( shmem );
+         record( r, CLAIM, perf_now() - t, &seed );
+
+         if ( -1 == slots[k] )
+            r->failed++;
+         own( board, r, slots[k], token );
+      }
+      else if ( roll < cfg->churn )
+      {
+         /* given up before the slot is, or the next claimant would look like a duplicate */
+         disown( board, slots[k], token );
+         slots[k] = -1;
+         __atomic_sub_fetch( &board->open, 1, __ATOMIC_ACQ_REL );
+
+         uint64_t t = perf_now();
+         close_shared_memory( shmems[k] );
+         record( r, CLOSE, perf_now() - t, &seed );
+         shmems[k] = NULL;
+
+         if ( idle )
+         {
+            idleUntil[k] = 0;
+            idling--;
+         }
+      }
+      else if ( roll < cfg->churn + cfg->reads )
+      {
+         uint64_t t = perf_now();
+         uint8_t group = tracks[k]->group;
+         for ( int s = next_group_member( shmems[k], group, -1 ); -1 != s; s = next_group_member( shmems[k], group, s ) )
+         {
+            spanned_slot_t* m = get_shared_memory_slot( shmems[k], s );
+            spanned_track_t* track = get_shared_memory_track( shmems[k], s );
+            uint32_t frameSize = __atomic_load_n( &m->frameSize, __ATOMIC_ACQUIRE );
+            if ( NULL == track || frameSize > MAX_FFT ) continue;
+
+            float sum = 0;
+            for ( int c = 0; c < MAX_CHANNELS; c++ )
+               for ( uint32_t b = 0; b < frameSize / 2 + 1; b++ )
+                  sum += track->fft[c][b];
+            sink += sum;
+            r->tracksRead++;
+         }
+         record( r, READ, perf_now() - t, &seed );
+      }
+      else
+      {
+         /* now and then a user moves to another group */
+         if ( 0 == rand_r( &seed ) % 64 )
+            tracks[k]->group = (uint8_t) (1 + rand_r( &seed ) % cfg->groups);
+
+         uint64_t t = perf_now();
+         update_shared_memory( shmems[k], tracks[k] );
+         record( r, PUBLISH, perf_now() - t, &seed );
+
+         /* back from idle, the slot may have been taken away and claimed again, by this user or another */
+         int slot = find_shared_memory_slot( shmems[k] );
+         if ( idle || slot != slots[k] )
+         {
+            r->moved += !idle && -1 != slots[k];
+            disown( board, slots[k], token );
+            own( board, r, slot, token & ~IDLE_OWNER );
+            slots[k] = slot;
+         }
+
+         if ( idle )
+         {
+            idleUntil[k] = 0;
+            idling--;
+         }
+         else if ( idling < cfg->idle && 0 == rand_r( &seed ) % IDLE_ODDS )
+         {
+            idleUntil[k] = perf_now() + IDLE_NS;
+            idling++;
+            r->idled++;
+            if ( -1 != slots[k] )
+               __atomic_compare_exchange_n( &board->owners[slots[k]], &token, token | IDLE_OWNER, 0, __ATOMIC_ACQ_REL,
+                                            __ATOMIC_RELAXED );
+         }
+      }
+   }
+
+   for ( int k = 0; k < cfg->users; k++ )
+   {
+      if ( NULL != shmems[k] )
+      {
+         disown( board, slots[k], (uint32_t) p << 16 | (uint32_t) (k + 1) | (0 != idleUntil[k] ? IDLE_OWNER : 0) );
+         __atomic_sub_fetch( &board->open, 1, __ATOMIC_ACQ_REL );
+         close_shared_memory( shmems[k] );
+      }
+      free_sample_data( tracks[k] );
+   }
+
+   (void) sink;
+}
+
+static int compare_ns( const void* a, const void* b )
+{
+   uint64_t x = *(const uint64_t*) a;
+   uint64_t y = *(const uint64_t*) b;
+   return (x > y) - (x < y);
+}
+
+static void usage( const char* name )
+{
+   fprintf( stderr,
+            "Usage: %s [-P processes] [-K users] [-t seconds] [-c ms] [-C percent] [-R percent] [-g groups]\n"
+            "          [-I users] [-f frameSize] [-a] [-F]\n"
+            "  -P processes  processes to fork (default 4)\n"
+            "  -K users      Shared Memory users in each process (default 8)\n"
+            "  -t seconds    how long to run (default 10)\n"
+            "  -c ms         check the invariants this often, 0 for only at the end (default 500)\n"
+            "  -C percent    operations that close a user, which is opened again when picked next (default 5)\n"
+            "  -R percent    operations that read a group, the rest publish (default 30)\n"
+            "  -g groups     groups the users are spread over (default 4)\n"
+            "  -I users      users of each process that may idle at once, long enough to lose their slot (default 1)\n"
+            "  -f frameSize  frame size of the published tracks, which sets how much a read copies (default 4096)\n"
+            "  -a            pin each process to a core of its own, where there are enough\n"
+            "  -F            run even though the Shared Memory exists, with plugins using it the checks will fail\n",
+            name );
+}
+
+int main( int argc, char** argv )
+{
+   config_t cfg = {
+      .processes = 4,
+      .users = 8,
+      .seconds = 10,
+      .checkMs = 500,
+      .churn = 5,
+      .reads = 30,
+      .groups = 4,
+      .idle = 1,
+      .frameSize = 4096,
+      .pin = 0,
+   };
+   int force = 0;
+
+   int opt;
+   while ( -1 != (opt = getopt( argc, argv, "P:K:t:c:C:R:g:I:f:aFh" )) )
+   {
+      switch ( opt )
+      {
+      case 'P':
+         cfg.processes = atoi( optarg );
+         break;
+      case 'K':
+         cfg.users = atoi( optarg );
+         break;
+      case 't':
+         cfg.seconds = strtod( optarg, NULL );
+         break;
+      case 'c':
+         cfg.checkMs = (uint32_t) strtoul( optarg, NULL, 10 );
+         break;
+      case 'C':
+         cfg.churn = atoi( optarg );
+         break;
+      case 'R':
+         cfg.reads = atoi( optarg );
+         break;
+      case 'g':
+         cfg.groups = atoi( optarg );
+         break;
+      case 'I':
+         cfg.idle = atoi( optarg );
+         break;
+      case 'f':
+         cfg.frameSize = (size_t) strtoul( optarg, NULL, 10 );
+         break;
+      case 'a':
+         cfg.pin = 1;
+         break;
+      case 'F':
+         force = 1;
+         break;
+      default:
+         usage( argv[0] );
+         return 1;
+      }
+   }
+
+   if ( cfg.processes <= 0 || cfg.processes > MAX_PROCESSES || cfg.users <= 0 || cfg.seconds <= 0 ||
+        cfg.churn < 0 || cfg.reads < 0 || cfg.churn + cfg.reads > 100 || cfg.groups <= 0 ||
+        cfg.groups > MAX_INSTANCES || cfg.idle < 0 || cfg.idle >= cfg.users || cfg.frameSize < 16 ||
+        cfg.frameSize > MAX_FFT )
+   {
+      usage( argv[0] );
+      return 1;
+   }
+
+   if ( cfg.processes * cfg.users > MAX_SLOTS )
+   {
+      fprintf( stderr, "%i users don't fit into %i slots\n", cfg.processes * cfg.users, MAX_SLOTS );
+      return 1;
+   }
+
+   int fd = shm_open( "/" SHMEMNAME, O_RDONLY, 0 );
+   if ( -1 != fd )
+   {
+      close( fd );
+      if ( !force )
+      {
+         fprintf( stderr, "/dev/shm/" SHMEMNAME " exists, close the plugins using it or pass -F\n" );
+         return 1;
+      }
+   }
+   int existed = -1 != fd;
+
+   size_t size = sizeof( board_t ) + (size_t) cfg.processes * sizeof( results_t );
+   board_t* board = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+   if ( MAP_FAILED == board )
+   {
+      fprintf( stderr, "Unable to map %zu bytes: %s\n", size, strerror( errno ) );
+      return 1;
+   }
+
+   pthread_barrierattr_t attr;
+   pthread_barrierattr_init( &attr );
+   pthread_barrierattr_setpshared( &attr, PTHREAD_PROCESS_SHARED );
+   pthread_barrier_init( &board->barrier, &attr, (unsigned) cfg.processes );
+   pthread_barrierattr_destroy( &attr );
+
+   fprintf( stderr, "Stressing the Shared Memory from %i processes with %i users each for %.1f s\n",
+            cfg.processes, cfg.users, cfg.seconds );
+
+   long cores = sysconf( _SC_NPROCESSORS_ONLN );
+   pid_t pids[MAX_PROCESSES];
+   for ( int p = 0; p < cfg.processes; p++ )
+   {
+      pids[p] = fork();
+      if ( 0 == pids[p] )
+      {
+         if ( cfg.pin && cores >= cfg.processes )
+         {
+            cpu_set_t set;
+            CPU_ZERO( &set );
+            CPU_SET( p, &set );
+            sched_setaffinity( 0, sizeof( set ), &set );
+         }
+         stress( board, &cfg, p );
+         _exit( 0 );
+      }
+      if ( -1 == pids[p] )
+      {
+         /* the others wait on the barrier forever, so take them down */
+         fprintf( stderr, "Unable to fork: %s\n", strerror( errno ) );
+         for ( int q = 0; q < p; q++ )
+            kill( pids[q], SIGKILL );
+         return 1;
+      }
+   }
+
+   /* a crashed process leaves the others waiting for it on the barrier */
+   int crashed = 0;
+   for ( int p = 0; p < cfg.processes; p++ )
+   {
+      int status;
+      if ( -1 == wait( &status ) ) break;
+      if ( (!WIFEXITED( status ) || 0 != WEXITSTATUS( status )) && !crashed++ )
+      {
+         for ( int q = 0; q < cfg.processes; q++ )
+            kill( pids[q], SIGKILL );
+      }
+   }
+
+   /* with every user closed, the last one must have taken the name away */
+   check( board );
+   int leftover = 0;
+   fd = shm_open( "/" SHMEMNAME, O_RDONLY, 0 );
+   if ( -1 != fd )
+   {
+      close( fd );
+      leftover = !existed;
+      if ( leftover )
+         shm_unlink( "/" SHMEMNAME );
+   }
+
+   printf( "measure,calls,per_second,mean_us,p50_us,p90_us,p99_us,p999_us,max_us\n" );
+
+   uint64_t* samples = malloc( (size_t) cfg.processes * SAMPLE_CAP * sizeof( uint64_t ) );
+   uint64_t tracksRead = 0, duplicates = 0, moved = 0, idled = 0, failed = 0;
+   for ( int i = 0; i < MEASURES; i++ )
+   {
+      uint64_t count = 0, total = 0;
+      size_t n = 0;
+      for ( int p = 0; p < cfg.processes; p++ )
+      {
+         measure_t* m = &board->results[p].measures[i];
+         count += m->count;
+         total += m->total;
+         memcpy( samples + n, m->samples, m->kept * sizeof( uint64_t ) );
+         n += m->kept;
+      }
+
+      if ( 0 == n )
+      {
+         printf( "%s,0,0,,,,,,\n", measureNames[i] );
+         continue;
+      }
+
+      qsort( samples, n, sizeof( uint64_t ), compare_ns );
+      printf( "%s,%lu,%.0f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n", measureNames[i], (unsigned long) count,
+              count / cfg.seconds,
+              total / 1e3 / count,
+              samples[n / 2] / 1e3,
+              samples[n * 90 / 100] / 1e3,
+              samples[n * 99 / 100] / 1e3,
+              samples[n * 999 / 1000] / 1e3,
+              samples[n - 1] / 1e3 );
+   }
+   free( samples );
+
+   for ( int p = 0; p < cfg.processes; p++ )
+   {
+      tracksRead += board->results[p].tracksRead;
+      duplicates += board->results[p].duplicates;
+      moved += board->results[p].moved;
+      idled += board->results[p].idled;
+      failed += board->results[p].failed;
+   }
+
+   fprintf( stderr, "Read %.0f tracks/s. %lu checks: %lu with a wrong user count, %lu slots lost, %lu orphaned, "
+                    "%lu wrong group memberships, %lu duplicate owners, %lu slots moved, %lu idle spells, "
+                    "%lu failed claims%s%s\n",
+            tracksRead / cfg.seconds, (unsigned long) board->checks, (unsigned long) board->users,
+            (unsigned long) board->missing, (unsigned long) board->orphans, (unsigned long) board->ghosts,
+            (unsigned long) duplicates, (unsigned long) moved, (unsigned long) idled, (unsigned long) failed,
+            leftover ? ", the Shared Memory was left behind" : "",
+            crashed ? ", a process crashed" : "" );
+
+   int broken = crashed || leftover || board->users || board->missing || board->orphans || board->ghosts ||
+                duplicates || moved || failed;
+
+   pthread_barrier_destroy( &board->barrier );
+   munmap( board, size );
+
+   return broken ? 1 : 0;
+}
@@ -50,4 +50,83 @@ inline void process_cascade( cascade_t* c, const float* in, float* out, size_t s
       }
       out[s] = c->out;
    }
-}
\ No newline at end of file
+}
+
+void set_filter_bank_target( filter_bank_t* bank, float freq, float q )
+{
+   bandpass_t target = { freq, q };
+   __atomic_store( &bank->target, &target, __ATOMIC_RELAXED );
+}
+
+/* states this close to 0 become denormals as they decay in silence, which are slow on most FPUs */
+static inline lanes_t flush_denormals( lanes_t z )
+{
+   const lanes_t tiny = (lanes_t) {} + 1e-30;
+   typeof( z < tiny ) small = (z < tiny) & (z > -tiny);
+   return (lanes_t) ((typeof( small )) z & ~small);
+}
+
+void process_filter_bank( filter_bank_t* bank, const float* const* in, float* const* out, size_t channels,
+                          size_t sampleCount )
+{
+   if ( 0 == sampleCount ) return;
+   if ( channels > MAX_CHANNELS ) channels = MAX_CHANNELS;
+
+   bandpass_t target;
+   __atomic_load( &bank->target, &target, __ATOMIC_RELAXED );
+
+   double a0 = bank->a0;
+   double b1 = bank->b1;
+   double b2 = bank->b2;
+   double da0 = 0, db1 = 0, db2 = 0;
+
+   /*
+    * The coefficients move in a straight line to the target's. That keeps the filter stable all the way, as the
+    * stable b1, b2 of a biquad form a triangle and every point between two stable ones is inside it as well.
+    */
+   if ( target.freq != bank->at.freq || target.q != bank->at.q )
+   {
+      biquad_t bq = { .freq = target.freq, .q = target.q };
+      update_biquad( &bq );
+      bank->at = target;
+      da0 = (bq.a0 - a0) / (double) sampleCount;
+      db1 = (bq.b1 - b1) / (double) sampleCount;
+      db2 = (bq.b2 - b2) / (double) sampleCount;
+      bank->a0 = bq.a0;
+      bank->b1 = bq.b1;
+      bank->b2 = bq.b2;
+   }
+
+   lanes_t z1[BP_SLOPE];
+   lanes_t z2[BP_SLOPE];
+   memcpy( z1, bank->z1, sizeof( z1 ) );
+   memcpy( z2, bank->z2, sizeof( z2 ) );
+
+   for ( size_t s = 0; s < sampleCount; ++s )
+   {
+      a0 += da0;
+      b1 += db1;
+      b2 += db2;
+
+      lanes_t x = {};
+      for ( size_t c = 0; c < channels; ++c )
+         x[c] = in[c][s];
+
+      for ( size_t bq = 0; bq < BP_SLOPE; ++bq )
+      {
+         lanes_t y = x * a0 + z1[bq];
+         z1[bq] = z2[bq] - y * b1;
+         z2[bq] = -a0 * x - y * b2;
+         x = y;
+      }
+
+      for ( size_t c = 0; c < channels; ++c )
+         out[c][s] = (float) x[c];
+   }
+
+   for ( size_t bq = 0; bq < BP_SLOPE; ++bq )
+   {
+      bank->z1[bq] = flush_denormals( z1[bq] );
+      bank->z2[bq] = flush_denormals( z2[bq] );
+   }
+}
@@ -1,12 +1,27 @@
 #ifndef CHANNELSPANNER_BIQUAD_H
 #define CHANNELSPANNER_BIQUAD_H
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define BP_SLOPE 3
 
+/* MAX_CHANNELS rounded up to a power of two, so every channel gets a lane of one vector */
+#if MAX_CHANNELS <= 2
+#define BANK_LANES 2
+#elif MAX_CHANNELS <= 4
+#define BANK_LANES 4
+#elif MAX_CHANNELS <= 8
+#define BANK_LANES 8
+#else
+#error "The filter bank has no more than 8 lanes"
+#endif
+
+typedef double lanes_t __attribute__((vector_size( BANK_LANES * sizeof( double ) )));
+
 typedef struct {
    float freq;
    float q;
@@ -25,10 +40,38 @@ typedef struct {
    biquad_t biquads[BP_SLOPE];
 } cascade_t;
 
+/* where a band-pass listens, small enough to be published in one atomic store */
+typedef struct {
+   float freq; /* normalized to the sample rate */
+   float q;
+} bandpass_t;
+
+/*
+ * The cascade of every channel in the lanes of one vector. The channels share their coefficients, which are moved
+ * from one block's to the next's across the block, so a new target never steps the output.
+ */
+typedef struct {
+   lanes_t z1[BP_SLOPE];
+   lanes_t z2[BP_SLOPE];
+   double a0; /* a1 is 0 and a2 is -a0 for a band-pass */
+   double b1;
+   double b2;
+   bandpass_t at;     /* what the coefficients were computed from, audio thread only */
+   bandpass_t target; /* published by set_filter_bank_target */
+} filter_bank_t;
+
+/* the scalar cascade of one channel, with coefficients that change at once */
 void update_cascade( cascade_t* c, float freq, float q );
 
 void process_cascade( cascade_t* c, const float* in, float* out, size_t sampleCount );
 
+/* safe from any thread while the bank processes, the audio thread picks it up with its next block */
+void set_filter_bank_target( filter_bank_t* bank, float freq, float q );
+
+/* in and out may be the same buffers, channels beyond MAX_CHANNELS are left alone */
+void process_filter_bank( filter_bank_t* bank, const float* const* in, float* const* out, size_t channels,
+                          size_t sampleCount );
+
 #ifdef __cplusplus
 }
 #endif
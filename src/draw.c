@@ -1,9 +1,14 @@
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
 #include <GL/glew.h>
-#include <fontconfig/fontconfig.h>
 
 #include "draw.h"
+#include "resources.h"
 #include "textshader.h"
+#include "spectrumshader.h"
+#include "waterfallshader.h"
 #include "units.h"
 #include "logging.h"
 
@@ -29,6 +34,8 @@
 #define VIOLET_DARK    0.627f,  0.224f,  0.506f
 #define VIOLET_LIGHT   0.824f,  0.224f,  0.647f
 
+#define HUD_INTERVAL 500000000ull /* ns */
+
 #define DB_MAX P_6_DB
 #define DB_MIN N_120_DB
 
@@ -54,6 +61,7 @@ const float COLORS[14][3] = {
 draw_ctx_t* init_draw_ctx( uint8_t scale, float sampleRate )
 {
    draw_ctx_t* ctx = malloc( sizeof( draw_ctx_t ) );
+   acquire_resources();
    ctx->init = 0;
    ctx->mousex = -1.0f;
    ctx->mousey = 1.0f;
@@ -62,21 +70,49 @@ draw_ctx_t* init_draw_ctx( uint8_t scale, float sampleRate )
    ctx->dpi = 96;
    ctx->scale = scale;
 
-   ctx->sr = sampleRate;
-   ctx->fm = sampleRate / 2.0f;
    ctx->dl = 0.025f;
    ctx->ox = 1.0f / SPECTRUM_FREQUENCY_MIN;
    ctx->oy = 1.0f / DB_MIN;
-   ctx->sx = 2.0f / (logf( ctx->fm ) - logf( SPECTRUM_FREQUENCY_MIN ));
    ctx->sy = 2.0f / (logf( DB_MIN ) - logf( DB_MAX ));
 
+   memset( ctx->maps, 0, sizeof( ctx->maps ) );
+   ctx->frame = 0;
+   ctx->background_fbo = 0;
+   ctx->background_dirty = 1;
+   ctx->waterfall = WATERFALL_OFF;
+   ctx->history_texture = 0;
+   ctx->history_bins = 0;
+   ctx->history_hz = 0;
+   ctx->history_head = 0;
+   ctx->history_stamp = 0;
+   ctx->history_row = NULL;
+   ctx->histories = calloc( MAX_SLOTS, sizeof( spectrum_history_t ) );
+   ctx->blend = malloc( (MAX_FFT / 2 + 1) * sizeof( float ) );
+   ctx->interpolating = 0;
+   set_sample_rate( ctx, sampleRate );
+
    ctx->info_dirty = 1;
    ctx->info_dB[0] = 0;
    ctx->info_Hz[0] = 0;
    ctx->info_note[0] = 0;
 
-   ctx->characters = malloc( 128 * sizeof( character_t ) );
+   ctx->characters = calloc( ATLAS_CHARACTERS, sizeof( character_t ) );
    ctx->program = 0;
+   ctx->atlas = 0;
+   ctx->atlas_dpi = 0;
+   ctx->atlas_width = ATLAS_WIDTH;
+   ctx->atlas_height = 1;
+   ctx->text_glyphs = 0;
+
+   ctx->spectrum_program = 0;
+   ctx->magnitude_count = 0;
+   ctx->magnitude_capacity = 0;
+   ctx->instances = NULL;
+   ctx->instance_count = 0;
+   ctx->instance_capacity = 0;
+   ctx->instance_points = 0;
+   memset( &ctx->stats, 0, sizeof( draw_stats_t ) );
+   set_hud( ctx, NULL );
 
    for ( int i = 0; i < MAX_FFT; i++ )
       ctx->xlog[i] = logf( i );
@@ -87,8 +123,20 @@ draw_ctx_t* init_draw_ctx( uint8_t scale, float sampleRate )
 void free_draw_ctx( draw_ctx_t* ctx )
 {
    if ( NULL == ctx ) return;
+   for ( int i = 0; i < BIN_MAPS; i++ )
+      free( ctx->maps[i].bins );
+   free( ctx->instances );
+   free( ctx->history_row );
+   for ( int i = 0; i < MAX_SLOTS; i++ )
+   {
+      free( ctx->histories[i].previous );
+      free( ctx->histories[i].current );
+   }
+   free( ctx->histories );
+   free( ctx->blend );
    free( ctx->characters );
    free( ctx );
+   release_resources();
 }
 
 void set_mouse( draw_ctx_t* ctx, int32_t mousex, int32_t mousey )
@@ -106,13 +154,87 @@ void set_mouse( draw_ctx_t* ctx, int32_t mousex, int32_t mousey )
    ctx->info_dirty = 1;
 }
 
-void draw_text( draw_ctx_t* ctx, const char* c, size_t charCount, float _x, float _y, float sx, float sy, float r, float g, float b, int halign, int valign )
+void set_sample_rate( draw_ctx_t* ctx, float sampleRate )
+{
+   if ( NULL == ctx ) return;
+
+   ctx->sr = sampleRate;
+   ctx->fm = sampleRate / 2.0f;
+   ctx->sx = 2.0f / (logf( ctx->fm ) - logf( SPECTRUM_FREQUENCY_MIN ));
+
+   /* every bin and grid line lands somewhere else now */
+   for ( int i = 0; i < BIN_MAPS; i++ )
+      ctx->maps[i].points = 0;
+   ctx->background_dirty = 1;
+}
+
+/* only what depends on the size changes, the GL objects and everything gathered so far are kept */
+void resize_draw_ctx( draw_ctx_t* ctx, uint8_t scale, int width, int height )
 {
+   if ( NULL == ctx ) return;
+   if ( width <= 0 || height <= 0 ) return;
+
+   ctx->scale = scale;
+   ctx->width = width;
+   ctx->height = height;
+   ctx->swidth = 2.0f / ctx->width;
+   ctx->sheight = 2.0f / ctx->height;
+   ctx->info_dirty = 1;
+}
+
+/* draw the glyphs gathered by draw_text */
+void draw_texts( draw_ctx_t* ctx )
+{
+   if ( NULL == ctx ) return;
+   if ( 0 == ctx->text_glyphs ) return;
+
    glUseProgram( ctx->program );
-   glUniform3f( glGetUniformLocation( ctx->program, "textColor" ), r, g, b );
+   glUniform3f( ctx->text_color, ctx->text_rgb[0], ctx->text_rgb[1], ctx->text_rgb[2] );
    glActiveTexture( GL_TEXTURE0 );
+   glBindTexture( GL_TEXTURE_2D, ctx->atlas );
    glBindVertexArray( ctx->vao );
 
+   glBindBuffer( GL_ARRAY_BUFFER, ctx->vbo );
+   glBufferSubData( GL_ARRAY_BUFFER, 0, ctx->text_glyphs * 6 * 4 * sizeof( GLfloat ), ctx->text_vertices );
+   glBindBuffer( GL_ARRAY_BUFFER, 0 );
+   glDrawArrays( GL_TRIANGLES, 0, (GLsizei) ctx->text_glyphs * 6 );
+   ctx->stats.draw_calls++;
+
+   glBindVertexArray( 0 );
+   glBindTexture( GL_TEXTURE_2D, 0 );
+   glUseProgram( 0 );
+   glDisable( GL_TEXTURE_2D );
+
+   ctx->text_glyphs = 0;
+}
+
+void set_waterfall( draw_ctx_t* ctx, int mode )
+{
+   if ( NULL == ctx ) return;
+
+   ctx->waterfall = mode;
+   ctx->history_stamp = 0;
+}
+
+void set_hud( draw_ctx_t* ctx, perf_t* perf )
+{
+   if ( NULL == ctx ) return;
+
+   ctx->perf = perf;
+   memset( ctx->hud_seen, 0, sizeof( ctx->hud_seen ) );
+   memset( ctx->hud, 0, sizeof( ctx->hud ) );
+   ctx->hud_sampled = 0;
+}
+
+void draw_text( draw_ctx_t* ctx, const char* c, size_t charCount, float _x, float _y, float sx, float sy, float r, float g, float b, int halign, int valign )
+{
+   if ( ctx->text_glyphs > 0 && (ctx->text_rgb[0] != r || ctx->text_rgb[1] != g || ctx->text_rgb[2] != b) )
+      draw_texts( ctx );
+
+   ctx->text_rgb[0] = r;
+   ctx->text_rgb[1] = g;
+   ctx->text_rgb[2] = b;
+
    if ( halign || valign )
    {
       float lx = 0.0f;
@@ -130,38 +252,41 @@ void draw_text( draw_ctx_t* ctx, const char* c, size_t charCount, float _x, floa
       if ( valign ) _y -= mh;
    }
 
+   float su = 1.0f / ctx->atlas_width;
+   float sv = 1.0f / ctx->atlas_height;
+
    for ( int i = 0; i < charCount; i++ )
    {
       if ( c[i] == 0 ) break;
       character_t ch = ctx->characters[(size_t) c[i]];
 
+      if ( ctx->text_glyphs == TEXT_GLYPHS )
+         draw_texts( ctx );
+
       GLfloat x = _x + ch.x * sx;
       GLfloat y = _y - (ch.h - ch.y) * sy;
       GLfloat w = ch.w * sx;
       GLfloat h = ch.h * sy;
 
+      GLfloat u0 = ch.ax * su;
+      GLfloat v0 = ch.ay * sv;
+      GLfloat u1 = (ch.ax + ch.w) * su;
+      GLfloat v1 = (ch.ay + ch.h) * sv;
+
       GLfloat vertices[6][4] = {
-              { x,     y + h,   0.0, 0.0 },
-              { x,     y,       0.0, 1.0 },
-              { x + w, y,       1.0, 1.0 },
+              { x,     y + h,   u0, v0 },
+              { x,     y,       u0, v1 },
+              { x + w, y,       u1, v1 },
 
-              { x,     y + h,   0.0, 0.0 },
-              { x + w, y,       1.0, 1.0 },
-              { x + w, y + h,   1.0, 0.0 }
+              { x,     y + h,   u0, v0 },
+              { x + w, y,       u1, v1 },
+              { x + w, y + h,   u1, v0 }
       };
 
-      glBindTexture( GL_TEXTURE_2D, ch.tex );
-      glBindBuffer( GL_ARRAY_BUFFER, ctx->vbo );
-      glBufferSubData( GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices );
-      glBindBuffer( GL_ARRAY_BUFFER, 0 );
-      glDrawArrays( GL_TRIANGLES, 0, 6 );
+      memcpy( ctx->text_vertices[ctx->text_glyphs * 6], vertices, sizeof( vertices ) );
+      ctx->text_glyphs++;
       _x += (ch.offset / 64) * sx;
    }
-
-   glBindVertexArray( 0 );
-   glBindTexture( GL_TEXTURE_2D, 0 );
-   glUseProgram( 0 );
-   glDisable( GL_TEXTURE_2D );
 }
 
 void draw_mouse( draw_ctx_t* ctx )
@@ -179,6 +304,7 @@ void draw_mouse( draw_ctx_t* ctx )
    glVertex2f(  1.0f, ctx->mousey );
 
    glEnd();
+   ctx->stats.draw_calls++;
 }
 
 void draw_info( draw_ctx_t* ctx )
@@ -225,6 +351,52 @@ void draw_info( draw_ctx_t* ctx )
    draw_text( ctx, ctx->info_dB, 10, ctx->mousex + 0.01f, ctx->mousey + 0.02f, ctx->swidth, ctx->sheight, WHITE, 0, 0 );
    draw_text( ctx, ctx->info_Hz, 10, ctx->mousex - 0.01f, ctx->mousey + 0.02f, ctx->swidth, ctx->sheight, WHITE, 1, 0 );
    draw_text( ctx, ctx->info_note, 8, ctx->mousex - 0.01f, ctx->mousey - 0.02f, ctx->swidth, ctx->sheight, WHITE, 1, 1 );
+
+   draw_texts( ctx );
+}
+
+/* timings of this instance and what the last frame drew, in the top left corner */
+void draw_hud( draw_ctx_t* ctx )
+{
+   if ( NULL == ctx ) return;
+   if ( NULL == ctx->perf ) return;
+
+   uint64_t now = perf_now();
+   if ( now - ctx->hud_sampled >= HUD_INTERVAL )
+   {
+      double seconds = (0 == ctx->hud_sampled) ? 1.0 : (now - ctx->hud_sampled) / 1e9;
+
+      perf_counter_t* counters[4] = { &ctx->perf->process, &ctx->perf->fft, &ctx->perf->copy, &ctx->perf->draw };
+      const char* names[4] = { "process", "fft", "copy", "draw" };
+
+      for ( int i = 0; i < 4; i++ )
+      {
+         uint64_t count = __atomic_load_n( &counters[i]->count, __ATOMIC_RELAXED );
+         uint64_t total = __atomic_load_n( &counters[i]->total, __ATOMIC_RELAXED );
+         uint64_t peak = __atomic_exchange_n( &counters[i]->peak, 0, __ATOMIC_RELAXED );
+
+         uint64_t calls = count - ctx->hud_seen[i].count;
+         double average = (0 == calls) ? 0.0 : (double) (total - ctx->hud_seen[i].total) / calls;
+
+         snprintf( ctx->hud[i], sizeof( ctx->hud[i] ), "%-7s %9.1f us avg %9.1f us peak %7.1f/s",
+                   names[i], average / 1e3, peak / 1e3, calls / seconds );
+
+         ctx->hud_seen[i].count = count;
+         ctx->hud_seen[i].total = total;
+      }
+
+      snprintf( ctx->hud[4], sizeof( ctx->hud[4] ), "tracks %zu  vertices %zu  draw calls %zu",
+                ctx->stats.tracks, ctx->stats.vertices, ctx->stats.draw_calls );
+
+      ctx->hud_sampled = now;
+   }
+
+   float line = 15.0f * ctx->dpi / 72.0f * ctx->sheight;
+   for ( int i = 0; i < 5; i++ )
+      draw_text( ctx, ctx->hud[i], sizeof( ctx->hud[i] ), -1.0f + 8 * ctx->swidth, 1.0f - (i + 1) * line,
+                 ctx->swidth, ctx->sheight, WHITE, 0, 0 );
+
+   draw_texts( ctx );
 }
 
 void draw_grid( draw_ctx_t* ctx )
@@ -269,134 +441,497 @@ void draw_grid( draw_ctx_t* ctx )
    }
 
    glEnd();
+   ctx->stats.draw_calls++;
 }
 
-void draw_shared_channel_spectrums( draw_ctx_t* ctx, shared_memory_t* shmem, u_int8_t group )
+void draw_spectrums( draw_ctx_t* ctx );
+
+/* clear to the background and draw the grid, from the cached copy unless the size, sample rate or DPI changed */
+void draw_background( draw_ctx_t* ctx )
 {
    if ( NULL == ctx ) return;
-   if ( NULL == shmem ) return;
 
-   spanned_track_t* tracks;
-   tracks = get_shared_memory_tracks( shmem );
+   if ( 0 == ctx->background_fbo )
+   {
+      glClearColor( BLACK, 1.0 );
+      glClear( GL_COLOR_BUFFER_BIT );
+      draw_grid( ctx );
+      return;
+   }
 
-   if ( NULL == tracks ) return;
+   GLint drawTarget = 0;
+   GLint readTarget = 0;
+   glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &drawTarget );
+   glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &readTarget );
 
-   float x, y, lx, a, b, df;
+   if ( ctx->background_dirty || ctx->background_dpi != ctx->dpi ||
+        ctx->background_width != ctx->width || ctx->background_height != ctx->height )
+   {
+      if ( ctx->background_width != ctx->width || ctx->background_height != ctx->height )
+      {
+         glBindTexture( GL_TEXTURE_2D, ctx->background_texture );
+         glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, ctx->width, ctx->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+         glBindTexture( GL_TEXTURE_2D, 0 );
+      }
+
+      glBindFramebuffer( GL_FRAMEBUFFER, ctx->background_fbo );
+      glClearColor( BLACK, 1.0 );
+      glClear( GL_COLOR_BUFFER_BIT );
+      draw_grid( ctx );
+
+      ctx->background_dirty = 0;
+      ctx->background_width = ctx->width;
+      ctx->background_height = ctx->height;
+      ctx->background_dpi = ctx->dpi;
+   }
+
+   glBindFramebuffer( GL_READ_FRAMEBUFFER, ctx->background_fbo );
+   glBindFramebuffer( GL_DRAW_FRAMEBUFFER, (GLuint) drawTarget );
+   glBlitFramebuffer( 0, 0, ctx->width, ctx->height, 0, 0, ctx->width, ctx->height, GL_COLOR_BUFFER_BIT, GL_NEAREST );
+   glBindFramebuffer( GL_READ_FRAMEBUFFER, (GLuint) readTarget );
+   ctx->stats.draw_calls++;
+}
 
-   for ( int t = 0; t < MAX_INSTANCES; t++ )
+/* find or build where the bins of a sample rate and FFT size land at the current width, NULL without room for any */
+bin_map_t* get_bin_map( draw_ctx_t* ctx, float sampleRate, size_t frameSize )
+{
+   if ( 0 == ctx->map_count ) return NULL;
+
+   bin_map_t* map = &ctx->maps[0];
+   for ( int i = 0; i < ctx->map_count; i++ )
    {
-      spanned_track_t* track = &tracks[t];
-      if ( is_this_track( shmem, track ) ) continue;
-      if ( group != track->group ) continue;
-      if ( 0 == track->id ) continue;
+      bin_map_t* m = &ctx->maps[i];
+      if ( 0 != m->points && m->sampleRate == sampleRate && m->frameSize == frameSize && m->width == ctx->width )
+      {
+         m->used = ctx->frame;
+         return m;
+      }
+      if ( m->used < map->used || 0 == m->points )
+         map = m;
+   }
 
-      df = logf( ctx->sr / track->frameSize * ctx->ox );
+   /* lines gathered this frame may still read the points that are about to be replaced */
+   if ( 0 != map->points && map->used == ctx->frame )
+      draw_spectrums( ctx );
 
-      for ( int ch = 0; ch < MAX_CHANNELS; ch++ )
+   map_bins( ctx, map, sampleRate, frameSize );
+   map->used = ctx->frame;
+
+   glBindBuffer( GL_TEXTURE_BUFFER, ctx->map_buffer );
+   glBufferSubData( GL_TEXTURE_BUFFER, (map - ctx->maps) * (MAX_FFT / 2 + 1) * 2 * sizeof( uint32_t ),
+                    map->points * 2 * sizeof( uint32_t ), map->bins );
+   glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+   return map;
+}
+
+/* the columns of the current width the bins land in, each point being a run of bins in one column */
+void map_bins( draw_ctx_t* ctx, bin_map_t* map, float sampleRate, size_t frameSize )
+{
+   size_t bins = frameSize / 2 + 1;
+   if ( map->frameSize < frameSize || NULL == map->bins )
+      map->bins = realloc( map->bins, bins * 2 * sizeof( uint32_t ) );
+
+   map->sampleRate = sampleRate;
+   map->frameSize = frameSize;
+   map->width = ctx->width;
+   map->points = 0;
+
+   float df = logf( sampleRate / frameSize * ctx->ox );
+   float columns = (float) ctx->width / 2.0f;
+   long lastColumn = -1;
+
+   for ( uint32_t i = 0; i < bins; i++ )
+   {
+      float x = (i == 0) ? -1.0f : ctx->sx * (ctx->xlog[i] + df) - 1;
+      if ( x >  1.0f ) x =  1.0f;
+      if ( x < -1.0f ) x = -1.0f;
+
+      /* shares a column with the previous bins, so it's drawn as their minimum and maximum */
+      long column = (long) ((x + 1.0f) * columns);
+      if ( column == lastColumn )
       {
-         glLineWidth( 3.0f );
-         glBegin( GL_LINE_STRIP );
+         map->bins[map->points * 2 - 1]++;
+         continue;
+      }
 
-         int colorOffset = (ch % 2 == 0) ? 0 : 1;
-         glColor4f( COLORS[track->color * 2 + colorOffset][0],
-                    COLORS[track->color * 2 + colorOffset][1],
-                    COLORS[track->color * 2 + colorOffset][2],
-                    0.5f
-         );
+      map->bins[map->points * 2] = i;
+      map->bins[map->points * 2 + 1] = 1;
+      map->points++;
+      lastColumn = column;
+   }
+}
 
-         lx = -1.0f;
+/* upload one channel's magnitudes and gather its spectrum line */
+void add_spectrum( draw_ctx_t* ctx, const float* fft, size_t frameSize, float sampleRate, const float* color, float alpha )
+{
+   size_t bins = frameSize / 2 + 1;
 
-//       a = (max'-min')/(max-min) // or more simply (max'-min')
-//       b = (min' - (a * min)) ) // or more simply min' + a
-         a = (track->frameSize < 2048) ? 2.5f : 1.0f;
-         b = (track->frameSize < 2048) ? 3.0f : 1.5f;
+   bin_map_t* map = get_bin_map( ctx, sampleRate, frameSize );
+   if ( NULL == map ) return;
 
-         for ( int i = 0; i < (track->frameSize >> 1) + 1; i++ )
-         {
-            x = ctx->sx * (ctx->xlog[i] + df ) - 1;
-            if ( i == 0 ) x = -1.0f;
+   if ( ctx->magnitude_count + bins > ctx->magnitude_capacity )
+      draw_spectrums( ctx );
 
-            y = ctx->sy * logf( track->fft[ch][i] * ctx->oy ) + 1;
+   glBindBuffer( GL_TEXTURE_BUFFER, ctx->magnitude_buffer );
+   /* orphan the last batch's storage so the uploads don't wait for it to be drawn */
+   if ( 0 == ctx->magnitude_count )
+      glBufferData( GL_TEXTURE_BUFFER, ctx->magnitude_capacity * sizeof( float ), NULL, GL_STREAM_DRAW );
+   glBufferSubData( GL_TEXTURE_BUFFER, ctx->magnitude_count * sizeof( float ), bins * sizeof( float ), fft );
+   glBindBuffer( GL_TEXTURE_BUFFER, 0 );
 
-            if ( x >  1.0f ) x =  1.0f;
-            if ( x < -1.0f ) x = -1.0f;
-            if ( y >  1.0f ) y =  1.1f;
-            if ( y < -1.0f ) y = -1.1f;
+   if ( ctx->instance_count == ctx->instance_capacity )
+   {
+      ctx->instance_capacity = (0 == ctx->instance_capacity) ? 64 : ctx->instance_capacity * 2;
+      ctx->instances = realloc( ctx->instances, ctx->instance_capacity * sizeof( spectrum_instance_t ) );
+   }
 
-            if ( i != 0 && (x - lx) > ctx->dl )
-            {
-               glVertex2f( x, -y );
-               glEnd();
-               glLineWidth( a * -x + b );
-               glBegin( GL_LINE_STRIP );
-               lx = x;
-            }
+   spectrum_instance_t* in = &ctx->instances[ctx->instance_count++];
+   in->magnitudes = (GLint) ctx->magnitude_count;
+   in->map = (GLint) ((map - ctx->maps) * (MAX_FFT / 2 + 1));
+   in->points = (GLint) map->points;
+   in->hz = sampleRate / frameSize;
+   in->r = color[0];
+   in->g = color[1];
+   in->b = color[2];
+   in->a = alpha;
+
+// a = (max'-min')/(max-min) // or more simply (max'-min')
+// b = (min' - (a * min)) ) // or more simply min' + a
+   in->wa = (frameSize < 2048) ? 2.5f : 1.0f;
+   in->wb = (frameSize < 2048) ? 3.0f : 1.5f;
+
+   ctx->magnitude_count += bins;
+   if ( map->points > ctx->instance_points )
+      ctx->instance_points = map->points;
+}
 
-            glVertex2f( x, -y );
-//          if ( i % 16 == 0 )
-//             DEBUG_PRINT( "%5.2f x %5.2f : %6i i %12.2f Hz %12.6f g %8.2f dB\n", x, -y, i, i * df, channel->fft[i], GAINTODB(channel->fft[i]) );
-         }
-         glEnd();
+static uint64_t now_raw_ns()
+{
+   struct timespec cl;
+   clock_gettime( CLOCK_MONOTONIC_RAW, &cl );
+   return (uint64_t) cl.tv_sec * 1000000000ull + (uint64_t) cl.tv_nsec;
+}
+
+/* take the slot's spectrum into its history when it published a new one since the last frame */
+spectrum_history_t* update_history( draw_ctx_t* ctx, shared_memory_t* shmem, int t )
+{
+   spanned_slot_t* slot = get_shared_memory_slot( shmem, t );
+   spanned_track_t* track = get_shared_memory_track( shmem, t );
+   if ( NULL == slot || NULL == track ) return NULL;
+
+   size_t frameSize = __atomic_load_n( &slot->frameSize, __ATOMIC_ACQUIRE );
+   if ( 0 == frameSize || frameSize > MAX_FFT ) return NULL;
+
+   spectrum_history_t* h = &ctx->histories[t];
+   long id = __atomic_load_n( &slot->id, __ATOMIC_ACQUIRE );
+   uint32_t updates = __atomic_load_n( &slot->updates, __ATOMIC_ACQUIRE );
+   uint64_t published = __atomic_load_n( &slot->published, __ATOMIC_RELAXED );
+   size_t bins = frameSize / 2 + 1;
+
+   if ( id != h->id || frameSize != h->frameSize )
+   {
+      h->previous = realloc( h->previous, MAX_CHANNELS * bins * sizeof( float ) );
+      h->current = realloc( h->current, MAX_CHANNELS * bins * sizeof( float ) );
+      h->id = id;
+      h->frameSize = frameSize;
+      h->interval = 0;
+   }
+   else if ( updates == h->updates )
+      return h;
+   else
+   {
+      float* previous = h->previous;
+      h->previous = h->current;
+      h->current = previous;
+      h->interval = (published > h->time && published - h->time < INTERPOLATE_MAX) ? published - h->time : 0;
+   }
+
+   for ( int ch = 0; ch < MAX_CHANNELS; ch++ )
+      memcpy( &h->current[ch * bins], track->fft[ch], bins * sizeof( float ) );
+   if ( 0 == h->interval )
+      memcpy( h->previous, h->current, MAX_CHANNELS * bins * sizeof( float ) );
+
+   h->updates = updates;
+   h->time = published;
+   return h;
+}
+
+/* the spectrum of one channel of a history as it's drawn now */
+const float* interpolate_history( draw_ctx_t* ctx, spectrum_history_t* h, int ch, uint64_t now )
+{
+   size_t bins = h->frameSize / 2 + 1;
+   const float* previous = &h->previous[ch * bins];
+   const float* current = &h->current[ch * bins];
+
+   if ( 0 == h->interval || now >= h->time + h->interval ) return current;
+
+   float k = (now > h->time) ? (float) (now - h->time) / (float) h->interval : 0.0f;
+   float* blend = ctx->blend;
+   for ( size_t i = 0; i < bins; i++ )
+      blend[i] = previous[i] + (current[i] - previous[i]) * k;
+
+   ctx->interpolating = 1;
+   return blend;
+}
+
+void draw_shared_channel_spectrums( draw_ctx_t* ctx, shared_memory_t* shmem, u_int8_t group )
+{
+   if ( NULL == ctx ) return;
+   if ( NULL == shmem ) return;
+
+   uint64_t now = now_raw_ns();
+
+   for ( int t = next_group_member( shmem, group, -1 ); -1 != t; t = next_group_member( shmem, group, t ) )
+   {
+      if ( is_this_slot( shmem, t ) ) continue;
+
+      spanned_slot_t* slot = get_shared_memory_slot( shmem, t );
+      spectrum_history_t* h = update_history( ctx, shmem, t );
+      if ( NULL == h ) continue;
+
+      float sampleRate = (0 != slot->sampleRate) ? (float) slot->sampleRate : ctx->sr;
+      uint8_t color = slot->color;
+
+      for ( int ch = 0; ch < MAX_CHANNELS; ch++ )
+      {
+         int colorOffset = (ch % 2 == 0) ? 0 : 1;
+         add_spectrum( ctx, interpolate_history( ctx, h, ch, now ), h->frameSize, sampleRate, COLORS[color * 2 + colorOffset], 0.5f );
       }
+
+      ctx->stats.tracks++;
    }
 }
 
-void draw_channel_spectrums( draw_ctx_t* ctx, track_t* track )
+/* this track is drawn from its own slot when it has one, so it's interpolated like the others */
+void draw_channel_spectrums( draw_ctx_t* ctx, track_t* track, shared_memory_t* shmem )
 {
    if ( NULL == ctx ) return;
    if ( NULL == track ) return;
 
-   float x, y, lx, a, b, df;
+   spectrum_history_t* h = NULL;
+   if ( NULL != shmem )
+   {
+      for ( int t = next_group_member( shmem, track->group, -1 ); -1 != t && NULL == h; t = next_group_member( shmem, track->group, t ) )
+      {
+         if ( is_this_slot( shmem, t ) )
+            h = update_history( ctx, shmem, t );
+      }
+   }
 
-   df = logf( ctx->sr / track->frameSize * ctx->ox );
+   uint64_t now = now_raw_ns();
 
-   channel_t* channel;
    for ( int ch = 0; ch < MAX_CHANNELS; ch++ )
    {
-      channel = &track->channels[ch];
+      int colorOffset = (ch % 2 == 0) ? 0 : 1;
+      if ( NULL != h )
+         add_spectrum( ctx, interpolate_history( ctx, h, ch, now ), h->frameSize, track->sampleRate, COLORS[track->color * 2 + colorOffset], 1.0f );
+      else
+         add_spectrum( ctx, track->channels[ch].fft, track->frameSize, track->sampleRate, COLORS[track->color * 2 + colorOffset], 1.0f );
+   }
 
-      glLineWidth( 3.0f );
-      glBegin( GL_LINE_STRIP );
+   ctx->stats.tracks++;
+}
 
-      int colorOffset = (ch % 2 == 0) ? 0 : 1;
-      glColor3f( COLORS[track->color * 2 + colorOffset][0],
-                 COLORS[track->color * 2 + colorOffset][1],
-                 COLORS[track->color * 2 + colorOffset][2] );
+/* a stamp of the spectrums in the waterfall, so a row is only added when one of them was updated */
+uint64_t waterfall_stamp( draw_ctx_t* ctx, track_t* track, shared_memory_t* shmem )
+{
+   if ( WATERFALL_GROUP == ctx->waterfall )
+      return group_updates( shmem, track->group );
 
-      lx = -1.0f;
+   for ( int t = next_group_member( shmem, track->group, -1 ); -1 != t; t = next_group_member( shmem, track->group, t ) )
+   {
+      if ( !is_this_slot( shmem, t ) ) continue;
+      spanned_slot_t* slot = get_shared_memory_slot( shmem, t );
+      return __atomic_load_n( &slot->updates, __ATOMIC_ACQUIRE );
+   }
 
-//    a = (max'-min')/(max-min) // or more simply (max'-min')
-//    b = (min' - (a * min)) ) // or more simply min' + a
-      a = (track->frameSize < 2048) ? 2.5f : 1.0f;
-      b = (track->frameSize < 2048) ? 3.0f : 1.5f;
+   /* without a slot of its own, e.g. after it was taken away, the track itself tells whether it was processed */
+   return __atomic_load_n( &track->processed, __ATOMIC_ACQUIRE );
+}
 
-      for ( int i = 0; i < track->frameSize / 2 + 1; i++ )
+/* add the newest row of the waterfall, a row is the loudest of every channel in each of this track's bins */
+void update_waterfall( draw_ctx_t* ctx, track_t* track, shared_memory_t* shmem )
+{
+   if ( NULL == ctx ) return;
+   if ( NULL == track ) return;
+
+   size_t bins = track->frameSize / 2 + 1;
+   float hz = track->sampleRate / track->frameSize;
+
+   if ( bins != ctx->history_bins || hz != ctx->history_hz )
+   {
+      GLint size = 0;
+      glGetIntegerv( GL_MAX_TEXTURE_SIZE, &size );
+      if ( bins > (size_t) size )
+      {
+         fprintf( stderr, "Unable to keep a waterfall of %zu bins\n", bins );
+         return;
+      }
+
+      /* the old history is meaningless at another resolution, so it starts over */
+      glBindTexture( GL_TEXTURE_2D, ctx->history_texture );
+      glTexImage2D( GL_TEXTURE_2D, 0, GL_R32F, (GLsizei) bins, WATERFALL_ROWS, 0, GL_RED, GL_FLOAT, NULL );
+      glBindTexture( GL_TEXTURE_2D, 0 );
+
+      GLint target = 0;
+      glGetIntegerv( GL_DRAW_FRAMEBUFFER_BINDING, &target );
+      glBindFramebuffer( GL_DRAW_FRAMEBUFFER, ctx->history_fbo );
+      glFramebufferTexture2D( GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ctx->history_texture, 0 );
+      glClearColor( 0.0f, 0.0f, 0.0f, 0.0f );
+      glClear( GL_COLOR_BUFFER_BIT );
+      glBindFramebuffer( GL_DRAW_FRAMEBUFFER, (GLuint) target );
+
+      ctx->history_row = realloc( ctx->history_row, bins * sizeof( float ) );
+      ctx->history_bins = bins;
+      ctx->history_hz = hz;
+      ctx->history_head = 0;
+      ctx->history_stamp = 0;
+   }
+
+   uint64_t stamp = waterfall_stamp( ctx, track, shmem );
+   if ( stamp == ctx->history_stamp ) return;
+   ctx->history_stamp = stamp;
+
+   float* row = ctx->history_row;
+   memcpy( row, track->channels[0].fft, bins * sizeof( float ) );
+   for ( int ch = 1; ch < MAX_CHANNELS; ch++ )
+      for ( size_t i = 0; i < bins; i++ )
+         row[i] = (track->channels[ch].fft[i] > row[i]) ? track->channels[ch].fft[i] : row[i];
+
+   /* members are sampled at the nearest of their bins, whatever their FFT size and sample rate */
+   if ( WATERFALL_GROUP == ctx->waterfall )
+   {
+      for ( int t = next_group_member( shmem, track->group, -1 ); -1 != t; t = next_group_member( shmem, track->group, t ) )
       {
-         if ( i == 0 ) x = -1.0f;
-         else x = ctx->sx * (ctx->xlog[i] + df) - 1;
+         if ( is_this_slot( shmem, t ) ) continue;
 
-         y = ctx->sy * logf( channel->fft[i] * ctx->oy ) + 1;
+         spanned_slot_t* slot = get_shared_memory_slot( shmem, t );
+         spanned_track_t* member = get_shared_memory_track( shmem, t );
+         if ( NULL == slot || NULL == member ) continue;
 
-         if ( x >  1.0f ) x =  1.0f;
-         if ( x < -1.0f ) x = -1.0f;
-         if ( y >  1.0f ) y =  1.1f;
-         if ( y < -1.0f ) y = -1.1f;
+         uint32_t frameSize = slot->frameSize;
+         float sampleRate = (0 != slot->sampleRate) ? (float) slot->sampleRate : ctx->sr;
+         if ( 0 == frameSize || frameSize > MAX_FFT ) continue;
 
-         if ( i != 0 && (x - lx) > ctx->dl )
+         size_t memberBins = frameSize / 2 + 1;
+         float ratio = hz / (sampleRate / frameSize);
+
+         for ( int ch = 0; ch < MAX_CHANNELS; ch++ )
          {
-            glVertex2f( x, -y );
-            glEnd();
-            glLineWidth( a * -x + b );
-            glBegin( GL_LINE_STRIP );
-            lx = x;
+            for ( size_t i = 0; i < bins; i++ )
+            {
+               size_t j = (size_t) (i * ratio + 0.5f);
+               if ( j >= memberBins ) break;
+               row[i] = (member->fft[ch][j] > row[i]) ? member->fft[ch][j] : row[i];
+            }
          }
-
-         glVertex2f( x, -y );
-//         if ( i % 16 == 0 )
-//            DEBUG_PRINT( "%5.2f x %5.2f : %6i i %12.2f Hz %12.6f g %8.2f dB\n", x, -y, i, i * df, channel->fft[i], GAINTODB(channel->fft[i]) );
       }
-      glEnd();
    }
+
+   ctx->history_head = (ctx->history_head + 1) % WATERFALL_ROWS;
+
+   glBindTexture( GL_TEXTURE_2D, ctx->history_texture );
+   glTexSubImage2D( GL_TEXTURE_2D, 0, 0, (GLint) ctx->history_head, (GLsizei) bins, 1, GL_RED, GL_FLOAT, row );
+   glBindTexture( GL_TEXTURE_2D, 0 );
+}
+
+void draw_waterfall( draw_ctx_t* ctx )
+{
+   if ( NULL == ctx ) return;
+   if ( 0 == ctx->history_bins ) return;
+
+   glUseProgram( ctx->waterfall_program );
+   glUniform4f( ctx->waterfall_mapping, ctx->sx, ctx->sy, ctx->ox, ctx->oy );
+   glUniform1f( ctx->waterfall_hz, ctx->history_hz );
+   glUniform1f( ctx->waterfall_bins, (float) ctx->history_bins );
+   glUniform1f( ctx->waterfall_head, (ctx->history_head + 0.5f) / WATERFALL_ROWS );
+   glUniform1f( ctx->waterfall_span, (WATERFALL_ROWS - 1.0f) / WATERFALL_ROWS );
+   glActiveTexture( GL_TEXTURE0 );
+   glBindTexture( GL_TEXTURE_2D, ctx->history_texture );
+
+   glBindVertexArray( ctx->waterfall_vao );
+   glDrawArrays( GL_TRIANGLE_STRIP, 0, 4 );
+   glBindVertexArray( 0 );
+
+   glBindTexture( GL_TEXTURE_2D, 0 );
+   glUseProgram( 0 );
+
+   ctx->stats.draw_calls++;
+}
+
+/* draw every gathered spectrum line at once */
+void draw_spectrums( draw_ctx_t* ctx )
+{
+   if ( NULL == ctx ) return;
+   if ( 0 == ctx->instance_count ) return;
+
+   glBindBuffer( GL_ARRAY_BUFFER, ctx->spectrum_vbo );
+   if ( ctx->instance_count > ctx->spectrum_capacity )
+      ctx->spectrum_capacity = ctx->instance_capacity;
+   glBufferData( GL_ARRAY_BUFFER, ctx->spectrum_capacity * sizeof( spectrum_instance_t ), NULL, GL_STREAM_DRAW );
+   glBufferSubData( GL_ARRAY_BUFFER, 0, ctx->instance_count * sizeof( spectrum_instance_t ), ctx->instances );
+   glBindBuffer( GL_ARRAY_BUFFER, 0 );
+
+   glUseProgram( ctx->spectrum_program );
+   glUniform2f( ctx->spectrum_viewport, ctx->width / 2.0f, ctx->height / 2.0f );
+   glUniform4f( ctx->spectrum_mapping, ctx->sx, ctx->sy, ctx->ox, ctx->oy );
+   glActiveTexture( GL_TEXTURE1 );
+   glBindTexture( GL_TEXTURE_BUFFER, ctx->magnitude_texture );
+   glActiveTexture( GL_TEXTURE2 );
+   glBindTexture( GL_TEXTURE_BUFFER, ctx->map_texture );
+
+   GLsizei vertices = (GLsizei) ctx->instance_points * 2;
+   glBindVertexArray( ctx->spectrum_vao );
+   glDrawArraysInstanced( GL_LINE_STRIP, 0, vertices, (GLsizei) ctx->instance_count );
+   glBindVertexArray( 0 );
+
+   glBindTexture( GL_TEXTURE_BUFFER, 0 );
+   glActiveTexture( GL_TEXTURE1 );
+   glBindTexture( GL_TEXTURE_BUFFER, 0 );
+   glActiveTexture( GL_TEXTURE0 );
+   glUseProgram( 0 );
+
+   ctx->stats.draw_calls++;
+   ctx->stats.vertices += vertices * ctx->instance_count;
+
+   ctx->magnitude_count = 0;
+   ctx->instance_count = 0;
+   ctx->instance_points = 0;
+}
+
+/* the glyphs at the current dpi into the atlas texture */
+void upload_glyphs( draw_ctx_t* ctx )
+{
+   const glyph_atlas_t* glyphs = get_glyph_atlas( ctx->dpi );
+   if ( NULL != glyphs )
+   {
+      memcpy( ctx->characters, glyphs->characters, sizeof( glyphs->characters ) );
+
+      if ( 0 == ctx->atlas )
+         glGenTextures( 1, &ctx->atlas );
+      glBindTexture( GL_TEXTURE_2D, ctx->atlas );
+      glTexImage2D(
+              GL_TEXTURE_2D,
+              0/*level*/,
+              GL_RED,
+              ATLAS_WIDTH,
+              glyphs->height,
+              0/*border*/,
+              GL_RED,
+              GL_UNSIGNED_BYTE,
+              glyphs->pixels
+      );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+      glBindTexture( GL_TEXTURE_2D, 0 );
+
+      ctx->atlas_height = glyphs->height;
+   }
+
+   ctx->atlas_dpi = ctx->dpi;
 }
 
 void init_draw( draw_ctx_t* ctx )
@@ -410,10 +945,14 @@ void init_draw( draw_ctx_t* ctx )
    glDisable( GL_MULTISAMPLE );
    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
 
-   GLint dims[4] = {0};
-   glGetIntegerv( GL_VIEWPORT, dims );
-   ctx->width = dims[2];
-   ctx->height = dims[3];
+   /* the window's size, unless it was resized since */
+   if ( 0 == ctx->width || 0 == ctx->height )
+   {
+      GLint dims[4] = {0};
+      glGetIntegerv( GL_VIEWPORT, dims );
+      ctx->width = dims[2];
+      ctx->height = dims[3];
+   }
    ctx->swidth = 2.0f / ctx->width;
    ctx->sheight = 2.0f / ctx->height;
 
@@ -426,120 +965,185 @@ void init_draw( draw_ctx_t* ctx )
    // GLEW generates GL error because it calls glGetString(GL_EXTENSIONS), we'll consume it here.
    glGetError();
 
-   FcConfig* config = FcInitLoadConfigAndFonts();
-
-   FcPattern* pat = FcNameParse( (const FcChar8*) "Monospace" );
-   FcConfigSubstitute( config, pat, FcMatchPattern );
-   FcDefaultSubstitute( pat );
-
-   FcResult result;
-   FcPattern* foundfont = FcFontMatch( config, pat, &result );
-   FcChar8* fontpath;
-   result = FcPatternGetString( foundfont, FC_FILE, 0, &fontpath );
-   if ( result != FcResultMatch )
-   {
-      DEBUG_PRINT( "Unable to find a Font: %i\n", result );
-   }
-   else
-   {
-      DEBUG_PRINT( "Using Font: %s\n", fontpath );
-
-      FT_Library freetype;
-      FT_Face fontface;
-
-      e = FT_Init_FreeType( &freetype );
-      if ( e )
-         fprintf( stderr, "Unable to load FreeType: %i\n", e );
-      else
-      {
-         e = FT_New_Face( freetype, (char*) fontpath, 0, &fontface );
-         if ( e )
-            fprintf( stderr, "Unable to load FreeType Font: %i\n", e );
-         else
-         {
-            FT_Set_Char_Size( fontface, 0, 10 * 64, 0, (FT_UInt) ctx->dpi );
-
-            for ( GLubyte c = 0; c < 128; c++ )
-            {
-               if ( FT_Load_Char( fontface, c, FT_LOAD_RENDER ) )
-               {
-                  fprintf( stderr, "Unable to load character: %i, %c\n", c, c );
-                  continue;
-               }
-               GLuint tex;
-               glGenTextures( 1, &tex );
-               glBindTexture( GL_TEXTURE_2D, tex );
-               glTexImage2D(
-                       GL_TEXTURE_2D,
-                       0/*level*/,
-                       GL_RED,
-                       fontface->glyph->bitmap.width,
-                       fontface->glyph->bitmap.rows,
-                       0/*border*/,
-                       GL_RED,
-                       GL_UNSIGNED_BYTE,
-                       fontface->glyph->bitmap.buffer
-               );
-               glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
-               glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
-               glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-               glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-
-               character_t ch = {
-                       tex,
-                       fontface->glyph->bitmap.width,
-                       fontface->glyph->bitmap.rows,
-                       fontface->glyph->bitmap_left,
-                       fontface->glyph->bitmap_top,
-                       fontface->glyph->advance.x
-               };
-               ctx->characters[c] = ch;
-            }
-
-            FT_Done_Face( fontface );
-         }
-
-         FT_Done_FreeType( freetype );
-      }
-   }
-
-   FcPatternDestroy( foundfont );
-   FcPatternDestroy( pat );
+   upload_glyphs( ctx );
 
    glGenVertexArrays( 1, &ctx->vao );
    glGenBuffers( 1, &ctx->vbo );
    glBindVertexArray( ctx->vao );
    glBindBuffer( GL_ARRAY_BUFFER, ctx->vbo );
-   glBufferData( GL_ARRAY_BUFFER, sizeof( GLfloat ) * 6 * 4, NULL, GL_DYNAMIC_DRAW );
+   glBufferData( GL_ARRAY_BUFFER, sizeof( ctx->text_vertices ), NULL, GL_DYNAMIC_DRAW );
    glEnableVertexAttribArray( 0 );
    glVertexAttribPointer( 0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof( GLfloat ), 0 );
    glBindBuffer( GL_ARRAY_BUFFER, 0 );
    glBindVertexArray( 0 );
 
    ctx->program = create_shader();
+   ctx->text_color = glGetUniformLocation( ctx->program, "textColor" );
+
+   glGenVertexArrays( 1, &ctx->spectrum_vao );
+   glGenBuffers( 1, &ctx->spectrum_vbo );
+   glBindVertexArray( ctx->spectrum_vao );
+   glBindBuffer( GL_ARRAY_BUFFER, ctx->spectrum_vbo );
+   glEnableVertexAttribArray( 0 );
+   glVertexAttribIPointer( 0, 3, GL_INT, sizeof( spectrum_instance_t ), (void*) offsetof( spectrum_instance_t, magnitudes ) );
+   glVertexAttribDivisor( 0, 1 );
+   glEnableVertexAttribArray( 1 );
+   glVertexAttribPointer( 1, 1, GL_FLOAT, GL_FALSE, sizeof( spectrum_instance_t ), (void*) offsetof( spectrum_instance_t, hz ) );
+   glVertexAttribDivisor( 1, 1 );
+   glEnableVertexAttribArray( 2 );
+   glVertexAttribPointer( 2, 4, GL_FLOAT, GL_FALSE, sizeof( spectrum_instance_t ), (void*) offsetof( spectrum_instance_t, r ) );
+   glVertexAttribDivisor( 2, 1 );
+   glEnableVertexAttribArray( 3 );
+   glVertexAttribPointer( 3, 2, GL_FLOAT, GL_FALSE, sizeof( spectrum_instance_t ), (void*) offsetof( spectrum_instance_t, wa ) );
+   glVertexAttribDivisor( 3, 1 );
+   glBindBuffer( GL_ARRAY_BUFFER, 0 );
+   glBindVertexArray( 0 );
+   ctx->spectrum_capacity = 0;
+
+   GLint texels = 0;
+   glGetIntegerv( GL_MAX_TEXTURE_BUFFER_SIZE, &texels );
+
+   /* room for every channel of a full group at the largest FFT, larger frames are drawn in several batches */
+   ctx->magnitude_capacity = (size_t) MAX_INSTANCES * MAX_CHANNELS * (MAX_FFT / 2 + 1);
+   if ( ctx->magnitude_capacity > (size_t) texels )
+      ctx->magnitude_capacity = (size_t) texels;
+   ctx->magnitude_count = 0;
+
+   glGenBuffers( 1, &ctx->magnitude_buffer );
+   glBindBuffer( GL_TEXTURE_BUFFER, ctx->magnitude_buffer );
+   glBufferData( GL_TEXTURE_BUFFER, ctx->magnitude_capacity * sizeof( float ), NULL, GL_STREAM_DRAW );
+   glGenTextures( 1, &ctx->magnitude_texture );
+   glBindTexture( GL_TEXTURE_BUFFER, ctx->magnitude_texture );
+   glTexBuffer( GL_TEXTURE_BUFFER, GL_R32F, ctx->magnitude_buffer );
+
+   /* GL 3.3 only guarantees 65536 texels, which falls just short of BIN_MAPS maps at the largest FFT */
+   ctx->map_count = (int) ((size_t) texels / (MAX_FFT / 2 + 1));
+   if ( ctx->map_count > BIN_MAPS )
+      ctx->map_count = BIN_MAPS;
+   if ( 0 == ctx->map_count )
+      fprintf( stderr, "Buffer textures of %i texels are too small for a bin map, spectrums are not drawn\n", texels );
+
+   glGenBuffers( 1, &ctx->map_buffer );
+   glBindBuffer( GL_TEXTURE_BUFFER, ctx->map_buffer );
+   glBufferData( GL_TEXTURE_BUFFER, (size_t) ctx->map_count * (MAX_FFT / 2 + 1) * 2 * sizeof( uint32_t ), NULL,
+                 GL_DYNAMIC_DRAW );
+   glGenTextures( 1, &ctx->map_texture );
+   glBindTexture( GL_TEXTURE_BUFFER, ctx->map_texture );
+   glTexBuffer( GL_TEXTURE_BUFFER, GL_RG32UI, ctx->map_buffer );
+
+   glBindTexture( GL_TEXTURE_BUFFER, 0 );
+   glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+
+   ctx->spectrum_program = create_spectrum_shader();
+   ctx->spectrum_viewport = glGetUniformLocation( ctx->spectrum_program, "viewport" );
+   ctx->spectrum_mapping = glGetUniformLocation( ctx->spectrum_program, "mapping" );
+   glUseProgram( ctx->spectrum_program );
+   glUniform1i( glGetUniformLocation( ctx->spectrum_program, "magnitudes" ), 1 );
+   glUniform1i( glGetUniformLocation( ctx->spectrum_program, "points" ), 2 );
+   glUseProgram( 0 );
+
+   glGenTextures( 1, &ctx->history_texture );
+   glBindTexture( GL_TEXTURE_2D, ctx->history_texture );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+   glBindTexture( GL_TEXTURE_2D, 0 );
+   glGenFramebuffers( 1, &ctx->history_fbo );
+   glGenVertexArrays( 1, &ctx->waterfall_vao );
+
+   ctx->waterfall_program = create_waterfall_shader();
+   ctx->waterfall_mapping = glGetUniformLocation( ctx->waterfall_program, "mapping" );
+   ctx->waterfall_hz = glGetUniformLocation( ctx->waterfall_program, "hz" );
+   ctx->waterfall_bins = glGetUniformLocation( ctx->waterfall_program, "bins" );
+   ctx->waterfall_head = glGetUniformLocation( ctx->waterfall_program, "head" );
+   ctx->waterfall_span = glGetUniformLocation( ctx->waterfall_program, "span" );
+
+   /* a multisampled window can't be blitted into, so it gets the grid drawn every frame */
+   GLint samples = 0;
+   glGetIntegerv( GL_SAMPLE_BUFFERS, &samples );
+   if ( 0 == samples )
+   {
+      GLint target = 0;
+      glGetIntegerv( GL_FRAMEBUFFER_BINDING, &target );
+
+      glGenTextures( 1, &ctx->background_texture );
+      glBindTexture( GL_TEXTURE_2D, ctx->background_texture );
+      glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA8, ctx->width, ctx->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+      glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+      glBindTexture( GL_TEXTURE_2D, 0 );
+
+      glGenFramebuffers( 1, &ctx->background_fbo );
+      glBindFramebuffer( GL_FRAMEBUFFER, ctx->background_fbo );
+      glFramebufferTexture2D( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ctx->background_texture, 0 );
+      if ( GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus( GL_FRAMEBUFFER ) )
+      {
+         fprintf( stderr, "Unable to create the background framebuffer\n" );
+         glDeleteFramebuffers( 1, &ctx->background_fbo );
+         glDeleteTextures( 1, &ctx->background_texture );
+         ctx->background_fbo = 0;
+      }
+      glBindFramebuffer( GL_FRAMEBUFFER, (GLuint) target );
+
+      ctx->background_width = ctx->width;
+      ctx->background_height = ctx->height;
+      ctx->background_dirty = 1;
+   }
 
    ctx->init = 1;
 }
 
+/* forget every GL object of a context that is gone, what's drawn from them is uploaded again with the new ones */
+void reset_draw( draw_ctx_t* ctx )
+{
+   ctx->init = 0;
+   ctx->atlas = 0;
+   ctx->atlas_dpi = 0;
+   ctx->background_fbo = 0;
+   ctx->background_dirty = 1;
+   ctx->history_bins = 0;
+   for ( int i = 0; i < BIN_MAPS; i++ )
+      ctx->maps[i].points = 0;
+}
+
 void draw( draw_ctx_t* ctx, track_t* track, shared_memory_t* shmem )
 {
    if ( NULL == ctx ) return;
    if ( NULL == track ) return;
 
+   /* lglw may replace the context when the window is resized, then only the GL objects are made again */
+   if ( ctx->init != 0 && !glIsProgram( ctx->spectrum_program ) )
+      reset_draw( ctx );
+
    if ( ctx->init == 0 ) init_draw( ctx );
 
-   glClearColor( BLACK, 1.0 );
-   glClear( GL_COLOR_BUFFER_BIT );
+   glViewport( 0, 0, ctx->width, ctx->height );
+   if ( ctx->atlas_dpi != ctx->dpi ) upload_glyphs( ctx );
+
+   memset( &ctx->stats, 0, sizeof( draw_stats_t ) );
+   ctx->frame++;
+   ctx->interpolating = 0;
+
+   draw_background( ctx );
 
-   draw_grid( ctx );
+   if ( WATERFALL_OFF != ctx->waterfall )
+   {
+      update_waterfall( ctx, track, shmem );
+      draw_waterfall( ctx );
+   }
 
    draw_mouse( ctx );
 
    draw_shared_channel_spectrums( ctx, shmem, track->group );
 
-   draw_channel_spectrums( ctx, track );
+   draw_channel_spectrums( ctx, track, shmem );
+
+   draw_spectrums( ctx );
 
    draw_info( ctx );
 
+   draw_hud( ctx );
+
    glFlush();
 }
\ No newline at end of file
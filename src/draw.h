@@ -7,13 +7,16 @@
 
 #include "process.h"
 #include "spanner.h"
+#include "perf.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* a glyph and where it is in the atlas */
 typedef struct {
-   uint tex;
+   int ax;
+   int ay;
    int w;
    int h;
    int x;
@@ -21,6 +24,73 @@ typedef struct {
    long offset;
 } character_t;
 
+/* one channel's spectrum line, drawn as one instance */
+typedef struct {
+   GLint magnitudes; /* first magnitude in the magnitude buffer */
+   GLint map;        /* first point in the map buffer */
+   GLint points;
+   GLfloat hz;       /* frequency step between bins */
+   GLfloat r;
+   GLfloat g;
+   GLfloat b;
+   GLfloat a;
+   GLfloat wa;       /* line width in pixels is wa * -x + wb */
+   GLfloat wb;
+} spectrum_instance_t;
+
+#define ATLAS_WIDTH 256
+#define TEXT_GLYPHS 64
+
+#define BIN_MAPS 8
+
+/* rows of history in the waterfall */
+#define WATERFALL_ROWS 512
+
+#define WATERFALL_OFF 0
+#define WATERFALL_TRACK 1 /* this track's channels */
+#define WATERFALL_GROUP 2 /* this track's channels and every group member's */
+
+/*
+ * Where the bins of one sample rate and FFT size land on screen. Neighbouring bins that share a pixel column are
+ * merged into one point, which is drawn as the minimum and maximum of those bins, so a line never has more than
+ * a couple of vertices per column. Each map has its own region of the map buffer, which is uploaded when the map
+ * is built.
+ */
+typedef struct {
+   float sampleRate;
+   size_t frameSize;
+   int width;
+   size_t points;
+   uint32_t* bins;  /* first bin and bin count of each point */
+   size_t used;     /* frame this map was last used in */
+} bin_map_t;
+
+/* spectrums published further apart than this are drawn as they come, without interpolating */
+#define INTERPOLATE_MAX 250000000ull /* ns */
+
+/*
+ * The last two spectrums a track published. Each frame draws the track part of the way from the previous to the
+ * current one, by how much of the time between their publication has passed since the current one was published.
+ * Lines then move at the display's rate however seldom the tracks are analysed, at the cost of trailing by one
+ * publication.
+ */
+typedef struct {
+   long id;           /* owner of the slot, the history starts over when it changes */
+   uint32_t updates;  /* update of the slot the current spectrum came from */
+   uint64_t time;     /* when the current spectrum was published */
+   uint64_t interval; /* from the previous to the current spectrum, 0 to draw the current one as it is */
+   size_t frameSize;
+   float* previous;   /* MAX_CHANNELS rows of bins */
+   float* current;
+} spectrum_history_t;
+
+/* counted over one call to draw() */
+typedef struct {
+   size_t draw_calls;
+   size_t vertices;
+   size_t tracks;
+} draw_stats_t;
+
 typedef struct {
    size_t init;
 
@@ -57,6 +127,82 @@ typedef struct {
    GLuint program;
    GLuint vao;
    GLuint vbo;
+   GLint text_color;
+
+   GLuint atlas;
+   int atlas_dpi; /* the glyphs in the atlas are for this dpi */
+   int atlas_width;
+   int atlas_height;
+
+   /* glyphs of the labels, drawn with one call for every run of labels in the same color */
+   GLfloat text_vertices[TEXT_GLYPHS * 6][4];
+   size_t text_glyphs;
+   float text_rgb[3];
+
+   GLuint spectrum_program;
+   GLuint spectrum_vao;
+   GLuint spectrum_vbo;
+   GLint spectrum_viewport;
+   GLint spectrum_mapping;
+   size_t spectrum_capacity; /* instances the VBO can hold */
+
+   /* raw magnitudes of every spectrum line, read by the vertex stage */
+   GLuint magnitude_buffer;
+   GLuint magnitude_texture;
+   size_t magnitude_count;
+   size_t magnitude_capacity;
+
+   /* the points of every bin map, map_count regions of MAX_FFT / 2 + 1 points */
+   GLuint map_buffer;
+   GLuint map_texture;
+   int map_count; /* up to BIN_MAPS, as many as a buffer texture holds */
+
+   /* spectrum lines are gathered here and drawn with one instanced draw call */
+   spectrum_instance_t* instances;
+   size_t instance_count;
+   size_t instance_capacity;
+   size_t instance_points; /* most points of any gathered line */
+
+   /* the grid is drawn into this once and copied into every frame, 0 when it's drawn every frame instead */
+   GLuint background_fbo;
+   GLuint background_texture;
+   int background_dirty;
+   int background_width;
+   int background_height;
+   int background_dpi;
+
+   /* the waterfall's history is a ring of rows of magnitudes, one row per update of the spectrum */
+   int waterfall;
+   GLuint waterfall_program;
+   GLuint waterfall_vao;
+   GLint waterfall_mapping;
+   GLint waterfall_hz;
+   GLint waterfall_bins;
+   GLint waterfall_head;
+   GLint waterfall_span;
+   GLuint history_texture;
+   GLuint history_fbo;
+   size_t history_bins;
+   float history_hz;
+   size_t history_head;
+   uint64_t history_stamp;
+   float* history_row;
+
+   bin_map_t maps[BIN_MAPS];
+   size_t frame;
+
+   /* one history per slot of the Shared Memory, the interpolated spectrum is put together in `blend` */
+   spectrum_history_t* histories;
+   float* blend;
+   int interpolating; /* the last frame was part of the way between two spectrums */
+
+   draw_stats_t stats;
+
+   /* the HUD shows these counters when set, sampled a couple of times a second */
+   perf_t* perf;
+   perf_counter_t hud_seen[4];
+   uint64_t hud_sampled;
+   char hud[5][64];
 
    character_t* characters;
 } draw_ctx_t;
@@ -67,8 +213,23 @@ void free_draw_ctx( draw_ctx_t* ctx );
 
 void set_mouse( draw_ctx_t* ctx, int32_t mousex, int32_t mousey );
 
+void set_sample_rate( draw_ctx_t* ctx, float sampleRate );
+
+void resize_draw_ctx( draw_ctx_t* ctx, uint8_t scale, int width, int height );
+
+void set_waterfall( draw_ctx_t* ctx, int mode );
+
+void set_hud( draw_ctx_t* ctx, perf_t* perf );
+
 void draw( draw_ctx_t* ctx, track_t* track, shared_memory_t* shmem );
 
+/* the per-frame work on the CPU, exposed for benchmarks */
+void map_bins( draw_ctx_t* ctx, bin_map_t* map, float sampleRate, size_t frameSize );
+
+spectrum_history_t* update_history( draw_ctx_t* ctx, shared_memory_t* shmem, int t );
+
+const float* interpolate_history( draw_ctx_t* ctx, spectrum_history_t* h, int ch, uint64_t now );
+
 #ifdef __cplusplus
 }
 #endif
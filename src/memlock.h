@@ -0,0 +1,40 @@
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+
+#include "logging.h"
+
+#ifndef CHANNELSPANNER_MEMLOCK_H
+#define CHANNELSPANNER_MEMLOCK_H
+
+#ifdef LOCK_MEMORY
+#define MAP_PREFAULT MAP_POPULATE
+#else
+#define MAP_PREFAULT 0
+#endif
+
+/* fault in and pin memory touched by the audio thread, returns 1 if it was locked */
+static inline int lock_memory( void* addr, size_t len, const char* what )
+{
+#ifdef LOCK_MEMORY
+   if ( 0 == mlock( addr, len ) )
+      return 1;
+
+   DEBUG_PRINT( "Unable to lock %s (%zu bytes), it may be swapped out: %s\n", what, len, strerror( errno ) );
+
+   /* without the lock the pages can still be faulted in now instead of on the audio thread */
+   volatile char* p = addr;
+   for ( size_t i = 0; i < len; i += 4096 )
+      p[i] = p[i];
+#endif
+   return 0;
+}
+
+static inline void unlock_memory( void* addr, size_t len )
+{
+#ifdef LOCK_MEMORY
+   munlock( addr, len );
+#endif
+}
+
+#endif //CHANNELSPANNER_MEMLOCK_H
@@ -0,0 +1,41 @@
+#ifndef CHANNELSPANNER_PERF_H
+#define CHANNELSPANNER_PERF_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Timing counters for the HUD. Each counter has a single writer, usually the audio thread, which only does relaxed
+ * atomic stores, so taking a measurement never locks or waits on the reader.
+ */
+
+typedef struct {
+   uint64_t count;
+   uint64_t total; /* ns */
+   uint64_t peak;  /* ns, taken and reset by the reader */
+} perf_counter_t;
+
+typedef struct {
+   perf_counter_t process; /* one call to processReplacing */
+   perf_counter_t fft;     /* windowing, FFT and smoothing of one block */
+   perf_counter_t copy;    /* publishing the spectrum into the Shared Memory */
+   perf_counter_t draw;    /* one frame of the editor */
+} perf_t;
+
+static inline uint64_t perf_now()
+{
+   struct timespec cl;
+   clock_gettime( CLOCK_MONOTONIC, &cl );
+   return (uint64_t) cl.tv_sec * 1000000000ull + (uint64_t) cl.tv_nsec;
+}
+
+static inline void perf_add( perf_counter_t* c, uint64_t ns )
+{
+   __atomic_store_n( &c->count, __atomic_load_n( &c->count, __ATOMIC_RELAXED ) + 1, __ATOMIC_RELAXED );
+   __atomic_store_n( &c->total, __atomic_load_n( &c->total, __ATOMIC_RELAXED ) + ns, __ATOMIC_RELAXED );
+   /* a peak that lands while the reader resets it may be lost, which is fine for a display */
+   if ( ns > __atomic_load_n( &c->peak, __ATOMIC_RELAXED ) )
+      __atomic_store_n( &c->peak, ns, __ATOMIC_RELAXED );
+}
+
+#endif //CHANNELSPANNER_PERF_H
@@ -3,6 +3,7 @@
 #include <string.h>
 
 #include "logging.h"
+#include "memlock.h"
 #include "process.h"
 
 void window_hanning( float* samples, size_t sampleCount )
@@ -11,41 +12,69 @@ void window_hanning( float* samples, size_t sampleCount )
       samples[i] = 0.5f * (1.0f - cosf( 2.0f * (float)M_PI * i / (sampleCount - 1.0f) ));
 }
 
-void init_working_area( track_t* track, size_t frameSize )
+/* FFTW's planner is not thread-safe, and working areas are now made on several threads */
+static pthread_mutex_t planner = PTHREAD_MUTEX_INITIALIZER;
+
+working_area_t* init_working_area( size_t frameSize )
 {
-   track->wrk = malloc( sizeof( working_area_t ) );
-   memset( track->wrk, 0, sizeof( working_area_t ) );
+   working_area_t* wrk = fftwf_malloc( sizeof( working_area_t ) );
+   memset( wrk, 0, sizeof( working_area_t ) );
+
+   wrk->frameSize = frameSize;
+   wrk->fftSize = frameSize / 2 + 1;
+   wrk->frameSizeInv = 1.0f / frameSize;
 
-   track->wrk->fftSize = frameSize / 2 + 1;
-   track->wrk->frameSizeInv = 1.0f / frameSize;
+   wrk->window = fftwf_alloc_real( frameSize );
+   window_hanning( wrk->window, frameSize );
 
-   track->wrk->window = fftwf_alloc_real( frameSize );
-   window_hanning( track->wrk->window, frameSize );
+   wrk->samplesTmp = fftwf_alloc_real( frameSize );
+   wrk->fftOutput = fftwf_alloc_complex( wrk->fftSize );
+   wrk->fftTmp = fftwf_alloc_real( wrk->fftSize );
 
-   track->wrk->samplesTmp = fftwf_alloc_real( frameSize );
-   track->wrk->fftOutput = fftwf_alloc_complex( track->wrk->fftSize );
-   track->wrk->fftTmp = fftwf_alloc_real( track->wrk->fftSize );
+   pthread_mutex_lock( &planner );
+   wrk->fftw = fftwf_plan_dft_r2c_1d( (int)frameSize, wrk->samplesTmp, wrk->fftOutput, FFTW_PATIENT );
+   pthread_mutex_unlock( &planner );
 
-   track->wrk->fftw = fftwf_plan_dft_r2c_1d( (int)frameSize, track->wrk->samplesTmp, track->wrk->fftOutput, FFTW_PATIENT );
+   int locked = lock_memory( wrk, sizeof( working_area_t ), "working area" );
+   locked &= lock_memory( wrk->window, frameSize * sizeof( float ), "window" );
+   locked &= lock_memory( wrk->samplesTmp, frameSize * sizeof( float ), "FFT input" );
+   locked &= lock_memory( wrk->fftOutput, wrk->fftSize * sizeof( fftwf_complex ), "FFT output" );
+   locked &= lock_memory( wrk->fftTmp, wrk->fftSize * sizeof( float ), "FFT magnitudes" );
+   wrk->locked = locked;
 
-   DEBUG_PRINT( "Setup Working area: %i samples + %i fftSamples at %p\n", MAX_FFT, (MAX_FFT / 2 + 1), track->wrk );
+   DEBUG_PRINT( "Setup Working area: %zu samples + %zu fftSamples at %p\n", frameSize, wrk->fftSize, wrk );
+   return wrk;
 }
 
-void free_working_area( track_t* track )
+void free_working_area( working_area_t* wrk )
 {
-   fftwf_destroy_plan( track->wrk->fftw );
-   fftwf_free( track->wrk->fftOutput );
-   fftwf_free( track->wrk->samplesTmp );
-   fftwf_free( track->wrk->fftTmp );
-   fftwf_free( track->wrk->window );
-   fftwf_free( track->wrk );
+   if ( NULL == wrk ) return;
+
+   unlock_memory( wrk->window, wrk->frameSize * sizeof( float ) );
+   unlock_memory( wrk->samplesTmp, wrk->frameSize * sizeof( float ) );
+   unlock_memory( wrk->fftOutput, wrk->fftSize * sizeof( fftwf_complex ) );
+   unlock_memory( wrk->fftTmp, wrk->fftSize * sizeof( float ) );
+   unlock_memory( wrk, sizeof( working_area_t ) );
+
+   pthread_mutex_lock( &planner );
+   fftwf_destroy_plan( wrk->fftw );
+   pthread_mutex_unlock( &planner );
+
+   fftwf_free( wrk->fftOutput );
+   fftwf_free( wrk->samplesTmp );
+   fftwf_free( wrk->fftTmp );
+   fftwf_free( wrk->window );
+   fftwf_free( wrk );
 }
 
+static void* prepare_working_areas( void* arg );
+
 track_t* init_sample_data( size_t frameSize )
 {
    track_t* t = malloc( sizeof( track_t ) );
    memset( t, 0, sizeof( track_t ) );
    t->frameSize = frameSize;
+   t->sampleRate = 44100.0f;
    t->color = 0;
    t->group = 1;
 
@@ -55,7 +84,14 @@ track_t* init_sample_data( size_t frameSize )
       memset( &t->channels[i].fft[0], 0, (MAX_FFT / 2 + 1) * sizeof( float ) );
    }
 
-   init_working_area( t, frameSize );
+   t->wrk = init_working_area( frameSize );
+   t->locked = lock_memory( t, sizeof( track_t ), "track" );
+
+   /* started here, where creating a thread is fine, so that requesting a frame size never has to */
+   sem_init( &t->wake, 0, 0 );
+   t->started = (0 == pthread_create( &t->worker, NULL, prepare_working_areas, t ));
+   if ( !t->started )
+      fprintf( stderr, "Unable to start preparing frame sizes, the frame size stays at %zu\n", frameSize );
 
    DEBUG_PRINT( "Setup SampleData: %i channels x (%i samples + %i fftSamples) at %p\n", MAX_CHANNELS, MAX_FFT, (MAX_FFT / 2 + 1), t );
    return t;
@@ -67,18 +103,79 @@ void free_sample_data( track_t* track )
 
    DEBUG_PRINT( "Destroying SampleData at %p\n", track );
 
-   free_working_area( track );
+   __atomic_store_n( &track->closing, 1, __ATOMIC_RELEASE );
+   sem_post( &track->wake );
+   if ( track->started )
+      pthread_join( track->worker, NULL );
+
+   sem_destroy( &track->wake );
+
+   free_working_area( track->pending );
+   free_working_area( track->retired );
+   free_working_area( track->wrk );
+   unlock_memory( track, sizeof( track_t ) );
    free( track );
 }
 
-void update_frame_size( track_t* track, size_t frameSize )
+/* the track's worker, woken for every request, every adoption and for closing */
+static void* prepare_working_areas( void* arg )
+{
+   track_t* track = arg;
+
+   while ( 1 )
+   {
+      sem_wait( &track->wake );
+      if ( __atomic_load_n( &track->closing, __ATOMIC_ACQUIRE ) )
+         break;
+
+      free_working_area( __atomic_exchange_n( &track->retired, NULL, __ATOMIC_ACQ_REL ) );
+
+      size_t frameSize = __atomic_exchange_n( &track->requested, 0, __ATOMIC_ACQ_REL );
+      if ( 0 == frameSize ) continue;
+
+      /* the audio thread may adopt `pending` meanwhile, but only ever swaps in what the worker prepared */
+      working_area_t* pending = __atomic_load_n( &track->pending, __ATOMIC_ACQUIRE );
+      size_t target = (NULL != pending) ? pending->frameSize : __atomic_load_n( &track->frameSize, __ATOMIC_ACQUIRE );
+      if ( target == frameSize ) continue;
+
+      /* one prepared earlier and not taken over yet is outdated now */
+      working_area_t* wrk = init_working_area( frameSize );
+      free_working_area( __atomic_exchange_n( &track->pending, wrk, __ATOMIC_ACQ_REL ) );
+   }
+
+   return NULL;
+}
+
+/* the frame size changes once the audio thread adopts the working area prepared for it; callable from the audio
+   thread, it neither locks nor allocates */
+void request_frame_size( track_t* track, size_t frameSize )
 {
    if ( NULL == track ) return;
-   if ( track->frameSize == frameSize ) return;
 
-   free_working_area( track );
-   track->frameSize = frameSize;
-   init_working_area( track, frameSize );
+   __atomic_store_n( &track->requested, frameSize, __ATOMIC_RELEASE );
+   sem_post( &track->wake );
+}
+
+/* between blocks on the audio thread, swaps to a prepared working area without allocating or freeing anything */
+void adopt_working_area( track_t* track )
+{
+   if ( NULL == track ) return;
+   if ( NULL == __atomic_load_n( &track->pending, __ATOMIC_ACQUIRE ) ) return;
+
+   /* the previous working area has to be freed first, there's only room for one */
+   if ( NULL != __atomic_load_n( &track->retired, __ATOMIC_ACQUIRE ) ) return;
+
+   working_area_t* wrk = __atomic_exchange_n( &track->pending, NULL, __ATOMIC_ACQ_REL );
+   if ( NULL == wrk ) return;
+
+   working_area_t* old = track->wrk;
+   track->wrk = wrk;
+   __atomic_store_n( &track->frameSize, wrk->frameSize, __ATOMIC_RELEASE );
+   for ( int i = 0; i < MAX_CHANNELS; ++i )
+      track->channels[i].head %= wrk->frameSize;
+
+   __atomic_store_n( &track->retired, old, __ATOMIC_RELEASE );
+   sem_post( &track->wake );
 }
 
 void add_sample_data( track_t* track, size_t channel, const float* samples, const size_t sampleCount )
@@ -184,4 +281,6 @@ void process_samples( track_t* track, float reactivity )
 
 //      DEBUG_PRINT( "Processed %zu samples for channel %zu\n", track->frameSize, ch );
    }
+
+   __atomic_add_fetch( &track->processed, 1, __ATOMIC_RELEASE );
 }
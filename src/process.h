@@ -2,6 +2,8 @@
 #define CHANNELSPANNER_PROCESS_H
 
 #include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <fftw3.h>
 
 #ifdef __cplusplus
@@ -27,6 +29,7 @@ extern "C" {
 // ignore 2nd half of bins
 
 typedef struct {
+   size_t frameSize;
    size_t fftSize;
    float frameSizeInv;
    float* window;
@@ -34,6 +37,7 @@ typedef struct {
    fftwf_complex* fftOutput;
    float* fftTmp;
    fftwf_plan fftw;
+   int locked; /* pinned in memory */
 } working_area_t;
 
 typedef struct {
@@ -44,17 +48,36 @@ typedef struct {
 
 typedef struct {
    size_t frameSize;
+   float sampleRate;
    uint8_t color;
    uint8_t group;
    channel_t channels[MAX_CHANNELS];
-   working_area_t* wrk;
+   working_area_t* wrk; /* only touched by the audio thread once it runs */
+   uint32_t processed; /* counts process_samples, for the editor to tell new spectrums from old ones */
+   int locked; /* track is pinned in memory */
+
+   /*
+    * A new FFT size gets its working area prepared by the track's worker thread, as allocating and planning can take
+    * far longer than a block. Requests, which may come from the audio thread, only store `requested` and post `wake`.
+    * The audio thread takes `pending` over between two blocks, leaves its old working area in `retired` and posts
+    * `wake` for the worker to free it; posting never blocks or allocates, unlike starting a thread or taking a lock.
+    */
+   working_area_t* pending;
+   working_area_t* retired;
+   sem_t wake;
+   pthread_t worker;    /* lives as long as the track */
+   int started;         /* the worker was started and has to be joined */
+   int closing;
+   size_t requested;    /* frame size the worker is to prepare next, 0 for none */
 } track_t;
 
 track_t* init_sample_data( size_t frameSize );
 
 void free_sample_data( track_t* track );
 
-void update_frame_size( track_t* track, size_t frameSize );
+void request_frame_size( track_t* track, size_t frameSize );
+
+void adopt_working_area( track_t* track );
 
 void add_sample_data( track_t* track, size_t channel, const float* samples, size_t sampleCount );
 
@@ -0,0 +1,259 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <GL/glew.h>
+#include <fontconfig/fontconfig.h>
+
+#include "resources.h"
+#include "logging.h"
+
+#define CACHED_PROGRAMS 8
+
+typedef struct {
+   const char* key;
+   GLenum format;
+   GLsizei length;
+   void* binary;
+} program_binary_t;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t refs = 0;
+
+static int font_resolved = 0;
+static char* font_path = NULL;
+static glyph_atlas_t* atlases = NULL;
+
+static program_binary_t programs[CACHED_PROGRAMS];
+
+static void resolve_font()
+{
+   font_resolved = 1;
+
+   FcConfig* config = FcInitLoadConfigAndFonts();
+
+   FcPattern* pat = FcNameParse( (const FcChar8*) "Monospace" );
+   FcConfigSubstitute( config, pat, FcMatchPattern );
+   FcDefaultSubstitute( pat );
+
+   FcResult result;
+   FcPattern* foundfont = FcFontMatch( config, pat, &result );
+   FcChar8* fontpath;
+   result = (NULL != foundfont) ? FcPatternGetString( foundfont, FC_FILE, 0, &fontpath ) : FcResultNoMatch;
+   if ( result != FcResultMatch )
+   {
+      DEBUG_PRINT( "Unable to find a Font: %i\n", result );
+   }
+   else
+   {
+      DEBUG_PRINT( "Using Font: %s\n", fontpath );
+      font_path = strdup( (const char*) fontpath );
+   }
+
+   if ( NULL != foundfont )
+      FcPatternDestroy( foundfont );
+   FcPatternDestroy( pat );
+   FcConfigDestroy( config );
+}
+
+static glyph_atlas_t* rasterize_glyphs( int dpi )
+{
+   FT_Library freetype;
+   FT_Face fontface;
+
+   int e = FT_Init_FreeType( &freetype );
+   if ( e )
+   {
+      fprintf( stderr, "Unable to load FreeType: %i\n", e );
+      return NULL;
+   }
+
+   e = FT_New_Face( freetype, font_path, 0, &fontface );
+   if ( e )
+   {
+      fprintf( stderr, "Unable to load FreeType Font: %i\n", e );
+      FT_Done_FreeType( freetype );
+      return NULL;
+   }
+
+   FT_Set_Char_Size( fontface, 0, 10 * 64, 0, (FT_UInt) dpi );
+
+   glyph_atlas_t* atlas = calloc( 1, sizeof( glyph_atlas_t ) );
+   atlas->dpi = dpi;
+
+   /* every glyph goes into one atlas, in rows from the top left with a texel of space around them */
+   int penx = 0;
+   int peny = 0;
+   int row = 0;
+
+   for ( int c = 0; c < ATLAS_CHARACTERS; c++ )
+   {
+      if ( FT_Load_Char( fontface, (FT_ULong) c, FT_LOAD_RENDER ) )
+      {
+         fprintf( stderr, "Unable to load character: %i, %c\n", c, c );
+         continue;
+      }
+
+      FT_Bitmap* bitmap = &fontface->glyph->bitmap;
+      int w = (int) bitmap->width;
+      int h = (int) bitmap->rows;
+
+      if ( penx + w + 1 > ATLAS_WIDTH )
+      {
+         penx = 0;
+         peny += row + 1;
+         row = 0;
+      }
+
+      if ( peny + h + 1 > atlas->height )
+      {
+         int grown = (0 == atlas->height) ? 64 : atlas->height * 2;
+         while ( peny + h + 1 > grown ) grown *= 2;
+         atlas->pixels = realloc( atlas->pixels, (size_t) grown * ATLAS_WIDTH );
+         memset( atlas->pixels + (size_t) atlas->height * ATLAS_WIDTH, 0, (size_t) (grown - atlas->height) * ATLAS_WIDTH );
+         atlas->height = grown;
+      }
+
+      for ( int y = 0; y < h; y++ )
+         memcpy( &atlas->pixels[(size_t) (peny + 1 + y) * ATLAS_WIDTH + penx + 1], &bitmap->buffer[y * bitmap->pitch], (size_t) w );
+
+      character_t ch = {
+              penx + 1,
+              peny + 1,
+              w,
+              h,
+              fontface->glyph->bitmap_left,
+              fontface->glyph->bitmap_top,
+              fontface->glyph->advance.x
+      };
+      atlas->characters[c] = ch;
+
+      penx += w + 1;
+      row = (h + 1 > row) ? h + 1 : row;
+   }
+
+   FT_Done_Face( fontface );
+   FT_Done_FreeType( freetype );
+
+   if ( NULL == atlas->pixels )
+   {
+      free( atlas );
+      return NULL;
+   }
+
+   return atlas;
+}
+
+void acquire_resources()
+{
+   pthread_mutex_lock( &lock );
+   refs++;
+   pthread_mutex_unlock( &lock );
+}
+
+void release_resources()
+{
+   pthread_mutex_lock( &lock );
+   if ( refs > 0 && 0 == --refs )
+   {
+      while ( NULL != atlases )
+      {
+         glyph_atlas_t* next = atlases->next;
+         free( atlases->pixels );
+         free( atlases );
+         atlases = next;
+      }
+
+      free( font_path );
+      font_path = NULL;
+      font_resolved = 0;
+
+      for ( int i = 0; i < CACHED_PROGRAMS; i++ )
+         free( programs[i].binary );
+      memset( programs, 0, sizeof( programs ) );
+   }
+   pthread_mutex_unlock( &lock );
+}
+
+const glyph_atlas_t* get_glyph_atlas( int dpi )
+{
+   pthread_mutex_lock( &lock );
+
+   if ( !font_resolved )
+      resolve_font();
+
+   glyph_atlas_t* atlas = atlases;
+   while ( NULL != atlas && atlas->dpi != dpi )
+      atlas = atlas->next;
+
+   if ( NULL == atlas && NULL != font_path )
+   {
+      atlas = rasterize_glyphs( dpi );
+      if ( NULL != atlas )
+      {
+         atlas->next = atlases;
+         atlases = atlas;
+      }
+   }
+
+   pthread_mutex_unlock( &lock );
+   return atlas;
+}
+
+GLuint load_program( const char* key )
+{
+   if ( !GLEW_ARB_get_program_binary ) return 0;
+
+   GLuint id = 0;
+   pthread_mutex_lock( &lock );
+
+   for ( int i = 0; i < CACHED_PROGRAMS && 0 == id; i++ )
+   {
+      program_binary_t* p = &programs[i];
+      if ( key != p->key ) continue;
+
+      id = glCreateProgram();
+      glProgramBinary( id, p->format, p->binary, p->length );
+
+      /* a binary from another driver or version of it doesn't link, then the program is built from source again */
+      GLint ok = GL_FALSE;
+      glGetProgramiv( id, GL_LINK_STATUS, &ok );
+      if ( GL_TRUE != ok )
+      {
+         DEBUG_PRINT( "Cached program binary was refused\n" );
+         glDeleteProgram( id );
+         id = 0;
+         break;
+      }
+   }
+
+   pthread_mutex_unlock( &lock );
+   return id;
+}
+
+void store_program( const char* key, GLuint program )
+{
+   if ( !GLEW_ARB_get_program_binary ) return;
+
+   GLint length = 0;
+   glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+   if ( length <= 0 ) return;
+
+   pthread_mutex_lock( &lock );
+
+   program_binary_t* p = NULL;
+   for ( int i = 0; i < CACHED_PROGRAMS && NULL == p; i++ )
+   {
+      if ( key == programs[i].key || NULL == programs[i].key )
+         p = &programs[i];
+   }
+
+   if ( NULL != p )
+   {
+      free( p->binary );
+      p->key = key;
+      p->binary = malloc( (size_t) length );
+      glGetProgramBinary( program, length, &p->length, &p->format, p->binary );
+   }
+
+   pthread_mutex_unlock( &lock );
+}
@@ -0,0 +1,47 @@
+#ifndef CHANNELSPANNER_RESOURCES_H
+#define CHANNELSPANNER_RESOURCES_H
+
+#include <GL/gl.h>
+
+#include "draw.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ATLAS_CHARACTERS 128
+
+/* the first ATLAS_CHARACTERS characters of the font at one dpi, rasterized into an atlas ATLAS_WIDTH texels wide */
+typedef struct glyph_atlas_s {
+   int dpi;
+   int height;
+   uint8_t* pixels;
+   character_t characters[ATLAS_CHARACTERS];
+   struct glyph_atlas_s* next;
+} glyph_atlas_t;
+
+/*
+ * What every editor of the process would otherwise set up again each time it's opened: the font's path, its glyphs
+ * rasterized for each dpi in use and the linked shader programs. These are kept while at least one reference is held,
+ * so plugin instances hold one for as long as they exist and reopening an editor finds everything ready.
+ *
+ * Programs are kept as the driver's binaries, as GL objects can't be shared between the contexts of the editors.
+ * Without ARB_get_program_binary every context links its own programs as before.
+ */
+void acquire_resources();
+
+void release_resources();
+
+/* NULL when no font could be loaded, valid until the reference is released */
+const glyph_atlas_t* get_glyph_atlas( int dpi );
+
+/* a program linked from the cached binary stored for `key`, or 0 when there is none or the driver refuses it */
+GLuint load_program( const char* key );
+
+void store_program( const char* key, GLuint program );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CHANNELSPANNER_RESOURCES_H
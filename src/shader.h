@@ -0,0 +1,65 @@
+#ifndef CHANNELSPANNER_SHADER_H
+#define CHANNELSPANNER_SHADER_H
+
+#include <GL/glew.h>
+
+#include "logging.h"
+#include "resources.h"
+
+GLuint compile_shader( GLenum type, const char* source )
+{
+   GLuint s = glCreateShader( type );
+   glShaderSource( s, 1, &source, NULL );
+   glCompileShader( s );
+
+   GLint ok = GL_FALSE;
+   glGetShaderiv( s, GL_COMPILE_STATUS, &ok );
+   if ( GL_TRUE != ok )
+   {
+      char log[1024];
+      glGetShaderInfoLog( s, sizeof( log ), NULL, log );
+      fprintf( stderr, "Unable to compile shader: %s\n", log );
+   }
+
+   return s;
+}
+
+/* link a program from its stages, the geometry stage is optional. Once linked, later contexts load its binary */
+GLuint create_program( const char* vert, const char* geom, const char* frag )
+{
+   GLuint id = load_program( vert );
+   if ( 0 != id ) return id;
+
+   id = glCreateProgram();
+   if ( GLEW_ARB_get_program_binary )
+      glProgramParameteri( id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+
+   GLuint v = compile_shader( GL_VERTEX_SHADER, vert );
+   GLuint g = (NULL != geom) ? compile_shader( GL_GEOMETRY_SHADER, geom ) : 0;
+   GLuint f = compile_shader( GL_FRAGMENT_SHADER, frag );
+
+   glAttachShader( id, v );
+   if ( 0 != g ) glAttachShader( id, g );
+   glAttachShader( id, f );
+
+   glLinkProgram( id );
+
+   GLint ok = GL_FALSE;
+   glGetProgramiv( id, GL_LINK_STATUS, &ok );
+   if ( GL_TRUE != ok )
+   {
+      char log[1024];
+      glGetProgramInfoLog( id, sizeof( log ), NULL, log );
+      fprintf( stderr, "Unable to link shader program: %s\n", log );
+   }
+   else
+      store_program( vert, id );
+
+   glDeleteShader( v );
+   if ( 0 != g ) glDeleteShader( g );
+   glDeleteShader( f );
+
+   return id;
+}
+
+#endif //CHANNELSPANNER_SHADER_H
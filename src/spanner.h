@@ -3,39 +3,81 @@
 
 #include "process.h"
 
-#define SHMEMNAME "ChannelSpanner"
+/* the suffix changes whenever spanner_t or spanned_segment_t change layout, so builds that disagree never map each
+   other's Shared Memory */
+#define SHMEMNAME "ChannelSpanner-2"
+
+/* seconds without an update before a slot is taken away from its instance */
+#define OLD_UPDATE 2
+
+/* slots across the first segment and every extra segment */
+#define MAX_SLOTS (MAX_INSTANCES * MAX_SEGMENTS)
+
+/* words in a bitmask covering every slot */
+#define SLOT_WORDS ((MAX_SLOTS + 63) / 64)
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* per-slot metadata, packed together so scanning the slots stays in a few cache lines */
 typedef struct {
    long id;
    long lastUpdate;
-   size_t frameSize;
+   uint64_t published; /* CLOCK_MONOTONIC_RAW nanoseconds of the last update */
+   uint32_t frameSize;
+   uint32_t sampleRate;
+   uint32_t updates; /* bumped on every update, so readers can tell when a track changed */
    uint8_t color;
    uint8_t group;
+} spanned_slot_t;
+
+typedef struct {
    float fft[MAX_CHANNELS][MAX_FFT / 2 + 1];
 } spanned_track_t;
 
+/* slots past the first MAX_INSTANCES live in extra segments named SHMEMNAME.<n>, created as needed */
 typedef struct {
-   size_t users;
    spanned_track_t tracks[MAX_INSTANCES];
+} spanned_segment_t;
+
+typedef struct {
+   size_t users;
+   uint32_t reach; /* one past the highest slot ever claimed */
+   uint64_t members[MAX_INSTANCES + 1][SLOT_WORDS]; /* live slots of each group, indexed by group */
+   spanned_slot_t slots[MAX_SLOTS];
+   spanned_segment_t first;
 } spanner_t;
 
 typedef struct shared_memory_t shared_memory_t;
 
 shared_memory_t* open_shared_memory();
 
+shared_memory_t* open_shared_memory_reader();
+
 void close_shared_memory( shared_memory_t* shmem );
 
 void update_shared_memory( shared_memory_t* shmem, track_t* track );
 
 void leave_shared_memory( shared_memory_t* shmem );
 
-spanned_track_t* get_shared_memory_tracks( shared_memory_t* shmem );
+int next_group_member( shared_memory_t* shmem, uint8_t group, int slot );
+
+spanned_slot_t* get_shared_memory_slot( shared_memory_t* shmem, int slot );
+
+spanned_track_t* get_shared_memory_track( shared_memory_t* shmem, int slot );
+
+uint64_t group_updates( shared_memory_t* shmem, uint8_t group );
+
+int is_this_slot( shared_memory_t* shmem, int slot );
+
+int shared_memory_locked( shared_memory_t* shmem );
+
+/* pin what the audio thread touches, not on the audio thread; opening already does */
+void lock_shared_memory( shared_memory_t* shmem );
 
-int is_this_track( shared_memory_t* shmem, spanned_track_t* track );
+/* this instance's slot, claiming one again in a mapped segment after it was taken away, or -1 */
+int find_shared_memory_slot( shared_memory_t* shmem );
 
 #ifdef __cplusplus
 }
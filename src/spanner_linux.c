@@ -1,8 +1,12 @@
 
 #include <sys/mman.h>
+#include <sys/file.h>
 #include <sys/types.h>
+#include <stddef.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <string.h>
@@ -11,114 +15,307 @@
 
 #include "spanner.h"
 #include "logging.h"
-
-#define OLD_UPDATE 2
+#include "memlock.h"
 
 struct shared_memory_t {
    int fd;
+   ino_t ino; /* of the Shared Memory joined, to tell whether the name still refers to it */
    long id;
+   int slot; /* last slot this instance claimed, or -1 */
+   int reader; /* only reads, never claims a slot */
+   int locked; /* header and this instance's track are pinned in memory */
+   int headerLocked;
+   int lockedSlot; /* whose track was pinned last, or -1 */
    spanner_t* spanner;
+   spanned_segment_t* segments[MAX_SEGMENTS]; /* mapped on first use, the first lives in the spanner */
 };
 
-/* find this instance's slot, the first empty slot, or -1 */
+#define SLOT_WORD(s) ((s) / 64)
+#define SLOT_BIT(s) (1ull << ((s) % 64))
+
+void segment_name( char* name, size_t len, int segment )
+{
+   snprintf( name, len, "/" SHMEMNAME ".%i", segment );
+}
+
+/* map an extra segment into this instance, creating it if asked */
+spanned_segment_t* map_shared_memory_segment( shared_memory_t* shmem, int segment, int create )
+{
+   spanned_segment_t* mapped = __atomic_load_n( &shmem->segments[segment], __ATOMIC_ACQUIRE );
+   if ( NULL != mapped ) return mapped;
+
+   char name[64];
+   segment_name( name, sizeof( name ), segment );
+
+   int fd = shm_open( name, O_RDWR | (create ? O_CREAT : 0), S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+   if ( -1 == fd )
+   {
+      if ( create )
+         DEBUG_PRINT( "Unable to open Shared Memory segment %s: %s\n", name, strerror( errno ) );
+      return NULL;
+   }
+
+   /* sizing to the same size is harmless, so whoever gets here first does not matter */
+   struct stat st;
+   if ( 0 != fstat( fd, &st ) || (st.st_size < (off_t) sizeof( spanned_segment_t ) &&
+                                  (!create || 0 != ftruncate( fd, sizeof( spanned_segment_t ) ))) )
+   {
+      if ( create )
+         DEBUG_PRINT( "Unable to resize Shared Memory segment %s: %s\n", name, strerror( errno ) );
+      close( fd );
+      return NULL;
+   }
+
+   mapped = mmap( NULL, sizeof( spanned_segment_t ), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_PREFAULT, fd, 0 );
+   close( fd );
+
+   if ( MAP_FAILED == mapped )
+   {
+      DEBUG_PRINT( "Unable to Map Shared Memory segment %s: %s\n", name, strerror( errno ) );
+      return NULL;
+   }
+
+   /* the editor maps segments as it draws them, while the audio thread looks for mapped ones */
+   spanned_segment_t* expected = NULL;
+   if ( !__atomic_compare_exchange_n( &shmem->segments[segment], &expected, mapped, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+   {
+      munmap( mapped, sizeof( spanned_segment_t ) );
+      return expected;
+   }
+
+   DEBUG_PRINT( "Mapped Shared Memory segment %s\n", name );
+   return mapped;
+}
+
+/* add a slot to a group's members, and no other group */
+void join_group( spanner_t* spanner, int slot, uint8_t group )
+{
+   for ( int g = 0; g <= MAX_INSTANCES; g++ )
+   {
+      if ( g == group )
+         __atomic_fetch_or( &spanner->members[g][SLOT_WORD( slot )], SLOT_BIT( slot ), __ATOMIC_RELEASE );
+      else
+         __atomic_fetch_and( &spanner->members[g][SLOT_WORD( slot )], ~SLOT_BIT( slot ), __ATOMIC_RELEASE );
+   }
+}
+
+/* remove a slot from every group's members */
+void leave_groups( spanner_t* spanner, int slot )
+{
+   for ( int g = 0; g <= MAX_INSTANCES; g++ )
+      __atomic_fetch_and( &spanner->members[g][SLOT_WORD( slot )], ~SLOT_BIT( slot ), __ATOMIC_RELEASE );
+}
+
+/* claim a slot if it is empty, its segment has to be mapped already */
+int claim_shared_memory_slot( shared_memory_t* shmem, int i, long now )
+{
+   spanned_slot_t* slots = shmem->spanner->slots;
+   if ( 0 != __atomic_load_n( &slots[i].id, __ATOMIC_RELAXED ) ) return 0;
+
+   /* stamped before the claim is visible, or a cleanup elsewhere takes the stamp of the last owner for a crash */
+   __atomic_store_n( &slots[i].lastUpdate, now, __ATOMIC_RELAXED );
+
+   long empty = 0;
+   if ( !__atomic_compare_exchange_n( &slots[i].id, &empty, shmem->id, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
+      return 0;
+
+   DEBUG_PRINT( "Found empty slot for %li at: %i\n", shmem->id, i );
+   uint32_t reach = __atomic_load_n( &shmem->spanner->reach, __ATOMIC_ACQUIRE );
+   while ( reach < i + 1 &&
+           !__atomic_compare_exchange_n( &shmem->spanner->reach, &reach, i + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) );
+
+   shmem->slot = i;
+   return 1;
+}
+
+/* find this instance's slot, claim an empty slot in a segment this instance has mapped, or -1; segments are only
+   created and mapped when opening, this runs on the audio thread */
 int find_shared_memory_slot( shared_memory_t* shmem )
 {
-   int slot = -1;
-   int emptySlot = -1;
+   if ( shmem->reader ) return -1;
+   spanned_slot_t* slots = shmem->spanner->slots;
+
+   if ( -1 != shmem->slot && shmem->id == __atomic_load_n( &slots[shmem->slot].id, __ATOMIC_ACQUIRE ) )
+      return shmem->slot;
+
+   struct timespec cl;
+   clock_gettime( CLOCK_MONOTONIC_RAW, &cl );
 
-   for ( int i = 0; i < MAX_INSTANCES; i++ )
+   /* taken away while this instance was idle, the same slot comes back unless somebody claimed it meanwhile */
+   if ( -1 != shmem->slot && claim_shared_memory_slot( shmem, shmem->slot, cl.tv_sec ) )
+      return shmem->slot;
+
+   shmem->slot = -1;
+
+   uint32_t reach = __atomic_load_n( &shmem->spanner->reach, __ATOMIC_ACQUIRE );
+   for ( int i = 0; i < reach; i++ )
    {
-      if ( shmem->id == shmem->spanner->tracks[i].id )
+      if ( shmem->id == __atomic_load_n( &slots[i].id, __ATOMIC_ACQUIRE ) )
       {
 //         DEBUG_PRINT( "Found this instance %li at: %i\n", shmem->id, i );
-         slot = i;
-         break;
-      }
-
-      if ( 0 == shmem->spanner->tracks[i].id && -1 == emptySlot )
-      {
-         shmem->spanner->tracks[i].id = shmem->id;
-         emptySlot = i;
+         shmem->slot = i;
+         return i;
       }
    }
 
-   if ( -1 == slot && -1 != emptySlot )
+   for ( int s = 0; s < MAX_SEGMENTS; s++ )
    {
-      DEBUG_PRINT( "Found empty slot for %li at: %i\n", shmem->id, emptySlot );
-      slot = emptySlot;
+      if ( NULL == __atomic_load_n( &shmem->segments[s], __ATOMIC_ACQUIRE ) ) continue;
+
+      for ( int i = s * MAX_INSTANCES; i < (s + 1) * MAX_INSTANCES; i++ )
+         if ( claim_shared_memory_slot( shmem, i, cl.tv_sec ) )
+            return i;
    }
 
-   return slot;
+   return -1;
+}
+
+/* pin the header and the track of this instance's slot; locking may block, so this runs when opening or resuming and
+   never on the audio thread, a slot claimed again there is pinned on the next call */
+void lock_shared_memory( shared_memory_t* shmem )
+{
+   if ( NULL == shmem || NULL == shmem->spanner || shmem->reader ) return;
+
+   if ( !shmem->headerLocked )
+      shmem->headerLocked = lock_memory( shmem->spanner, offsetof( spanner_t, first ), "shared memory header" );
+
+   int slot = __atomic_load_n( &shmem->slot, __ATOMIC_RELAXED );
+   if ( -1 == slot || slot == shmem->lockedSlot ) return;
+
+   /* the track pinned before stays locked until the segment is unmapped, a neighbour in this process may share its
+      pages */
+   spanned_segment_t* segment = __atomic_load_n( &shmem->segments[slot / MAX_INSTANCES], __ATOMIC_ACQUIRE );
+   shmem->lockedSlot = slot;
+   shmem->locked = shmem->headerLocked &&
+                   lock_memory( &segment->tracks[slot % MAX_INSTANCES], sizeof( spanned_track_t ), "shared track" );
+}
+
+/* decrement the user count without going below zero, returns the count before */
+size_t release_user( spanner_t* spanner )
+{
+   size_t users = __atomic_load_n( &spanner->users, __ATOMIC_ACQUIRE );
+   while ( users > 0 &&
+           !__atomic_compare_exchange_n( &spanner->users, &users, users - 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) );
+   return users;
 }
 
 /* if an instance crashed or lost connection somehow, remove its data */
 void clear_old_shared_memory( shared_memory_t* shmem, long now )
 {
-   for ( int i = 0; i < MAX_INSTANCES; i++ )
+   uint32_t reach = __atomic_load_n( &shmem->spanner->reach, __ATOMIC_ACQUIRE );
+   for ( int i = 0; i < reach; i++ )
    {
-      spanned_track_t* t = &shmem->spanner->tracks[i];
-      if ( 0 != t->id && (now - t->lastUpdate) > OLD_UPDATE )
+      spanned_slot_t* s = &shmem->spanner->slots[i];
+      long id = __atomic_load_n( &s->id, __ATOMIC_ACQUIRE );
+      long lastUpdate = __atomic_load_n( &s->lastUpdate, __ATOMIC_ACQUIRE );
+      /* only the slot is taken away, an idle instance is still a user until it closes */
+      if ( 0 != id && (now - lastUpdate) > OLD_UPDATE )
       {
-         DEBUG_PRINT( "Clearing old slot %i; %li - %li > %i\n", i, now, t->lastUpdate, OLD_UPDATE );
-         t->id = 0;
-         if ( shmem->spanner->users > 0 )
-         {
-            shmem->spanner->users -= 1;
-         }
+         DEBUG_PRINT( "Clearing old slot %i; %li - %li > %i\n", i, now, lastUpdate, OLD_UPDATE );
+         leave_groups( shmem->spanner, i );
+         __atomic_compare_exchange_n( &s->id, &id, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED );
       }
    }
 }
 
-shared_memory_t* open_shared_memory()
+static shared_memory_t* open_shared_memory_as( int reader )
 {
    shared_memory_t* shmem = malloc( sizeof( shared_memory_t ) );
+   memset( shmem, 0, sizeof( shared_memory_t ) );
    shmem->fd = -1;
+   shmem->slot = -1;
+   shmem->reader = reader;
+   shmem->lockedSlot = -1;
    shmem->spanner = NULL;
    shmem->id = arc4random() % ((unsigned)RAND_MAX + 1);
 
    DEBUG_PRINT( "Creating a new Shared Memory instance with ID: %li\n", shmem->id );
 
-   shmem->fd = shm_open( "/" SHMEMNAME,
-                         O_RDWR | O_CREAT | O_EXCL,
-                         S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+   /* creating, sizing, joining and taking the name away all happen under a lock on it, so nobody maps it before it is
+      sized and nobody joins it just as the last user takes it away */
+   struct stat st;
+   for ( ;; )
+   {
+      shmem->fd = shm_open( "/" SHMEMNAME,
+                            O_RDWR | O_CREAT,
+                            S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
+
+      if ( -1 == shmem->fd )
+      {
+         DEBUG_PRINT( "Unable to open File Descriptor for the Shared Memory: %s\n", strerror( errno ) );
+         return shmem;
+      }
+
+      if ( 0 != flock( shmem->fd, LOCK_EX ) || 0 != fstat( shmem->fd, &st ) )
+      {
+         DEBUG_PRINT( "Unable to lock the Shared Memory: %s\n", strerror( errno ) );
+         close( shmem->fd );
+         shmem->fd = -1;
+         return shmem;
+      }
+
+      if ( st.st_nlink > 0 ) break;
+
+      DEBUG_PRINT( "Shared Memory was taken away while waiting for it, trying again\n" );
+      close( shmem->fd );
+   }
 
-   if ( -1 != shmem->fd )
+   shmem->ino = st.st_ino;
+
+   if ( st.st_size < (off_t) sizeof( spanner_t ) )
    {
       DEBUG_PRINT( "Newly created Shared Memory, initializing\n" );
       if ( 0 != ftruncate( shmem->fd, sizeof( spanner_t ) ) )
       {
          DEBUG_PRINT( "Unable to resize the Shared Memory: %s\n", strerror( errno ) );
+         close( shmem->fd );
+         shmem->fd = -1;
          return shmem;
       }
    }
-   else if ( EEXIST == errno )
-   {
-      DEBUG_PRINT( "Shared Memory exists already, trying to connect\n" );
-
-      shmem->fd = shm_open( "/" SHMEMNAME,
-                            O_RDWR | O_CREAT,
-                            S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP );
-   }
-
-   if ( -1 == shmem->fd )
+   else
    {
-      DEBUG_PRINT( "Unable to open File Descriptor for the Shared Memory: %s\n", strerror( errno ) );
-      return shmem;
+      DEBUG_PRINT( "Shared Memory exists already, connecting\n" );
    }
 
    DEBUG_PRINT( "Mapping Shared Memory\n" );
    shmem->spanner = mmap( NULL, sizeof( spanner_t ),
-                          PROT_READ | PROT_WRITE, MAP_SHARED, shmem->fd, 0 );
+                          PROT_READ | PROT_WRITE, MAP_SHARED | MAP_PREFAULT, shmem->fd, 0 );
 
    if ( MAP_FAILED == shmem->spanner )
    {
       shmem->spanner = NULL;
       DEBUG_PRINT( "Unable to Map the Shared Memory: %s\n", strerror( errno ) );
    }
+   else
+   {
+      shmem->segments[0] = &shmem->spanner->first;
+      size_t users = __atomic_fetch_add( &shmem->spanner->users, 1, __ATOMIC_ACQ_REL );
+      DEBUG_PRINT( "Increasing Shared Memory User Count (%zu -> %zu)\n", users, users + 1 );
+   }
 
-   DEBUG_PRINT( "Increasing Shared Memory User Count (%zu -> %zu)\n", shmem->spanner->users, shmem->spanner->users + 1 );
-   shmem->spanner->users += 1;
+   if ( NULL != shmem->spanner && !reader )
+   {
+      /* the slot is claimed here, where creating a segment for it may block; the audio thread only claims again within
+         segments mapped by then, so every existing one is mapped too */
+      struct timespec cl;
+      clock_gettime( CLOCK_MONOTONIC_RAW, &cl );
+      for ( int s = 0; s < MAX_SEGMENTS; s++ )
+      {
+         if ( NULL == map_shared_memory_segment( shmem, s, -1 == shmem->slot ) ) continue;
 
+         for ( int i = s * MAX_INSTANCES; i < (s + 1) * MAX_INSTANCES && -1 == shmem->slot; i++ )
+            claim_shared_memory_slot( shmem, i, cl.tv_sec );
+      }
+
+      if ( -1 == shmem->slot )
+         DEBUG_PRINT( "Unable to find a slot in Shared Memory, every segment is full\n" );
+
+      lock_shared_memory( shmem );
+   }
+
+   /* the mapping keeps the file open, which would keep it locked too */
+   flock( shmem->fd, LOCK_UN );
    DEBUG_PRINT( "Closing Shared Memory File Descriptor\n" );
    close( shmem->fd );
    shmem->fd = -1;
@@ -126,6 +323,17 @@ shared_memory_t* open_shared_memory()
    return shmem;
 }
 
+shared_memory_t* open_shared_memory()
+{
+   return open_shared_memory_as( 0 );
+}
+
+/* maps the Shared Memory and counts as a user, but never claims a slot or creates a segment, for tools that watch */
+shared_memory_t* open_shared_memory_reader()
+{
+   return open_shared_memory_as( 1 );
+}
+
 void close_shared_memory( shared_memory_t* shmem )
 {
    if ( NULL == shmem )
@@ -136,40 +344,66 @@ void close_shared_memory( shared_memory_t* shmem )
 
    if ( NULL != shmem->spanner )
    {
-      if ( shmem->spanner->users > 0 )
-      {
-         DEBUG_PRINT( "Reducing Shared Memory User Count (%zu -> %zu)\n", shmem->spanner->users, shmem->spanner->users - 1 );
-         shmem->spanner->users -= 1;
-      }
+      /* the name is only ours to take away while it is still the one this instance joined */
+      int fd = shm_open( "/" SHMEMNAME, O_RDWR, 0 );
+      struct stat st;
+      int owned = -1 != fd && 0 == flock( fd, LOCK_EX ) && 0 == fstat( fd, &st ) && st.st_ino == shmem->ino;
+
+      size_t users = release_user( shmem->spanner );
+      DEBUG_PRINT( "Reduced Shared Memory User Count from %zu\n", users );
 
       leave_shared_memory( shmem );
 
+      for ( int i = 1; i < MAX_SEGMENTS; i++ )
+         if ( NULL != shmem->segments[i] )
+            munmap( shmem->segments[i], sizeof( spanned_segment_t ) );
+
       DEBUG_PRINT( "Unmapping Shared Memory\n" );
       if ( 0 != munmap( shmem->spanner, sizeof( spanner_t ) ) )
       {
          DEBUG_PRINT( "Unable to UnMap the Shared Memory: %s\n", strerror( errno ) );
       }
-   }
 
-   DEBUG_PRINT( "Unlinking Shared Memory\n" );
-   if ( 0 != shm_unlink( "/" SHMEMNAME ) )
-   {
-      DEBUG_PRINT( "Unable to Unlink the Shared Memory: %s\n", strerror( errno ) );
+      /* only the last user takes the names away, so later instances still find everyone else */
+      if ( owned && users <= 1 )
+      {
+         DEBUG_PRINT( "Unlinking Shared Memory\n" );
+         if ( 0 != shm_unlink( "/" SHMEMNAME ) )
+         {
+            DEBUG_PRINT( "Unable to Unlink the Shared Memory: %s\n", strerror( errno ) );
+         }
+
+         char name[64];
+         for ( int i = 1; i < MAX_SEGMENTS; i++ )
+         {
+            segment_name( name, sizeof( name ), i );
+            shm_unlink( name );
+         }
+      }
+
+      if ( -1 != fd )
+      {
+         flock( fd, LOCK_UN );
+         close( fd );
+      }
    }
 
    free( shmem );
 }
 
+/* give up the slot this instance holds, if it still holds one; leaving never claims a slot only to give it back */
 void leave_shared_memory( shared_memory_t* shmem )
 {
-   if ( NULL != shmem->spanner )
+   if ( NULL != shmem->spanner && -1 != shmem->slot )
    {
-      int slot = find_shared_memory_slot( shmem );
-
-      if ( -1 != slot )
+      int slot = shmem->slot;
+      long id = shmem->id;
+      if ( id == __atomic_load_n( &shmem->spanner->slots[slot].id, __ATOMIC_ACQUIRE ) )
       {
-         shmem->spanner->tracks[slot].id = 0;
+         leave_groups( shmem->spanner, slot );
+         __atomic_compare_exchange_n( &shmem->spanner->slots[slot].id, &id, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED );
       }
+      shmem->slot = -1;
    }
 }
 
@@ -180,12 +414,16 @@ void update_shared_memory( shared_memory_t* shmem, track_t* track )
       DEBUG_PRINT( "Skip updating non-existent Shared Memory!\n" );
       return;
    }
+   if ( shmem->reader ) return;
 
    struct timespec cl;
    clock_gettime( CLOCK_MONOTONIC_RAW, &cl );
 
    clear_old_shared_memory( shmem, cl.tv_sec );
 
+   /* the group indexes the members, there's no group 0 and none past MAX_INSTANCES */
+   if ( track->group < 1 || track->group > MAX_INSTANCES ) return;
+
    int slot = find_shared_memory_slot( shmem );
 
    if ( -1 == slot )
@@ -194,33 +432,108 @@ void update_shared_memory( shared_memory_t* shmem, track_t* track )
       return;
    }
 
-   spanned_track_t* t = &shmem->spanner->tracks[slot];
-   t->id = shmem->id;
-   t->lastUpdate = cl.tv_sec;
-   t->color = track->color;
-   t->group = track->group;
-   t->frameSize = track->frameSize;
+   spanned_track_t* t = &shmem->segments[slot / MAX_INSTANCES]->tracks[slot % MAX_INSTANCES];
    for ( int c = 0; c < MAX_CHANNELS; c++ )
       for ( int s = 0; s < (MAX_FFT / 2 + 1); s++ )
          t->fft[c][s] = track->channels[c].fft[s];
+
+   spanned_slot_t* m = &shmem->spanner->slots[slot];
+   __atomic_store_n( &m->lastUpdate, cl.tv_sec, __ATOMIC_RELEASE );
+   __atomic_store_n( &m->published, (uint64_t) cl.tv_sec * 1000000000ull + (uint64_t) cl.tv_nsec, __ATOMIC_RELAXED );
+   __atomic_store_n( &m->color, track->color, __ATOMIC_RELAXED );
+   __atomic_store_n( &m->sampleRate, (uint32_t) track->sampleRate, __ATOMIC_RELAXED );
+   __atomic_store_n( &m->frameSize, (uint32_t) track->frameSize, __ATOMIC_RELEASE );
+   __atomic_add_fetch( &m->updates, 1, __ATOMIC_RELEASE );
+
+   /* membership is (re)asserted here, so a group change or a racing cleanup heals on the next update */
+   uint64_t* members = shmem->spanner->members[track->group];
+   if ( track->group != __atomic_load_n( &m->group, __ATOMIC_ACQUIRE ) ||
+        0 == (__atomic_load_n( &members[SLOT_WORD( slot )], __ATOMIC_ACQUIRE ) & SLOT_BIT( slot )) )
+   {
+      __atomic_store_n( &m->group, track->group, __ATOMIC_RELEASE );
+      join_group( shmem->spanner, slot, track->group );
+   }
+}
+
+/* next live slot after `slot` in a group, or -1; start with -1 */
+int next_group_member( shared_memory_t* shmem, uint8_t group, int slot )
+{
+   if ( NULL == shmem || NULL == shmem->spanner ) return -1;
+   if ( group > MAX_INSTANCES ) return -1;
+
+   uint64_t* members = shmem->spanner->members[group];
+
+   for ( int s = slot + 1; s < MAX_SLOTS; )
+   {
+      uint64_t word = __atomic_load_n( &members[SLOT_WORD( s )], __ATOMIC_ACQUIRE );
+      word &= ~(SLOT_BIT( s ) - 1);
+      if ( 0 != word )
+      {
+         int found = SLOT_WORD( s ) * 64 + __builtin_ctzll( word );
+         return (found < MAX_SLOTS) ? found : -1;
+      }
+      s = (SLOT_WORD( s ) + 1) * 64;
+   }
+
+   return -1;
+}
+
+/* a stamp of every member of a group and their updates, it changes whenever something drawn for the group does */
+uint64_t group_updates( shared_memory_t* shmem, uint8_t group )
+{
+   uint64_t stamp = 0;
+
+   for ( int s = next_group_member( shmem, group, -1 ); -1 != s; s = next_group_member( shmem, group, s ) )
+   {
+      uint32_t updates = __atomic_load_n( &shmem->spanner->slots[s].updates, __ATOMIC_ACQUIRE );
+      stamp = stamp * 31 + ((uint64_t) s << 32 | updates);
+   }
+
+   return stamp;
 }
 
-spanned_track_t* get_shared_memory_tracks( shared_memory_t* shmem )
+spanned_slot_t* get_shared_memory_slot( shared_memory_t* shmem, int slot )
 {
-   if ( NULL == shmem || NULL == shmem->spanner )
+   if ( NULL == shmem || NULL == shmem->spanner || slot < 0 || slot >= MAX_SLOTS )
    {
       return NULL;
    }
 
-   return shmem->spanner->tracks;
+   return &shmem->spanner->slots[slot];
 }
 
-int is_this_track( shared_memory_t* shmem, spanned_track_t* track )
+spanned_track_t* get_shared_memory_track( shared_memory_t* shmem, int slot )
 {
-   if ( NULL == shmem || NULL == track )
+   if ( NULL == shmem || NULL == shmem->spanner || slot < 0 || slot >= MAX_SLOTS )
+   {
+      return NULL;
+   }
+
+   spanned_segment_t* segment = map_shared_memory_segment( shmem, slot / MAX_INSTANCES, 0 );
+   if ( NULL == segment )
+   {
+      return NULL;
+   }
+
+   return &segment->tracks[slot % MAX_INSTANCES];
+}
+
+int is_this_slot( shared_memory_t* shmem, int slot )
+{
+   if ( NULL == shmem || NULL == shmem->spanner || slot < 0 || slot >= MAX_SLOTS )
+   {
+      return 0;
+   }
+
+   return shmem->id == __atomic_load_n( &shmem->spanner->slots[slot].id, __ATOMIC_ACQUIRE );
+}
+
+int shared_memory_locked( shared_memory_t* shmem )
+{
+   if ( NULL == shmem )
    {
       return 0;
    }
 
-   return shmem->id == track->id;
-}
\ No newline at end of file
+   return shmem->locked;
+}
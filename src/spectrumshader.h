@@ -0,0 +1,134 @@
+#ifndef CHANNELSPANNER_SPECTRUMSHADER_H
+#define CHANNELSPANNER_SPECTRUMSHADER_H
+
+#include <GL/glew.h>
+
+#include "shader.h"
+
+/*
+ * Spectrum lines are drawn straight from the raw magnitudes. Every track channel is one instance, and its
+ * magnitudes and bin map are read from buffer textures, so the vertex stage does the mapping to log frequency and
+ * dB that the CPU used to do for every bin. Two vertices are drawn per point of the bin map: a point of several
+ * bins becomes their minimum and maximum, a point of one bin is drawn twice.
+ *
+ * Every segment is expanded into a quad in the geometry stage. The fragment stage fades the edges of the quad,
+ * which antialiases lines of any width without GL_LINE_SMOOTH.
+ */
+
+const char* spectrum_vert =
+        "#version 330 core\n"
+                "\n"
+                "layout(location = 0) in ivec3 strip;\n" // first magnitude, first point, points
+                "layout(location = 1) in float hz;\n" // frequency step between bins
+                "layout(location = 2) in vec4 color;\n"
+                "layout(location = 3) in vec2 widths;\n"
+                "uniform samplerBuffer magnitudes;\n"
+                "uniform usamplerBuffer points;\n"
+                "uniform vec4 mapping;\n" // sx, sy, ox, oy
+                "uniform vec2 viewport;\n"
+                "out vec4 vColor;\n"
+                "out float vWidth;\n"
+                "out float vValid;\n"
+                "\n"
+                "void main(void) {\n"
+                "    int p = gl_VertexID / 2;\n"
+                "    vColor = color;\n"
+                "    vWidth = 0.0;\n"
+                "    vValid = 0.0;\n"
+                "    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);\n"
+                "    if (p >= strip.z) return;\n"
+                "\n"
+                "    uvec2 point = texelFetch(points, strip.y + p).rg;\n"
+                "    int first = strip.x + int(point.x);\n"
+                "    int count = int(point.y);\n"
+                "\n"
+                "    float x = (point.x == 0u) ? -1.0 : mapping.x * (log(float(point.x)) + log(hz * mapping.z)) - 1.0;\n"
+                "    x = clamp(x, -1.0, 1.0);\n"
+                "\n"
+                "    float gain = texelFetch(magnitudes, first).r;\n"
+                "    if (count > 1) {\n"
+                "        x = (floor((x + 1.0) * viewport.x) + 0.5) / viewport.x - 1.0;\n"
+                "        float last = texelFetch(magnitudes, first + count - 1).r;\n"
+                "        float lo = gain;\n"
+                "        float hi = gain;\n"
+                "        for (int i = 1; i < count; i++) {\n"
+                "            float m = texelFetch(magnitudes, first + i).r;\n"
+                "            lo = min(lo, m);\n"
+                "            hi = max(hi, m);\n"
+                "        }\n"
+                "        // follow the direction the bins go in, so the line doesn't double back\n"
+                "        bool rising = gain <= last;\n"
+                "        bool second = (gl_VertexID & 1) == 1;\n"
+                "        gain = (rising != second) ? lo : hi;\n"
+                "    }\n"
+                "\n"
+                "    float y = mapping.y * log(max(gain, 1e-20) * mapping.w) + 1.0;\n"
+                "    if (y > 1.0) y = 1.1;\n"
+                "    if (y < -1.0) y = -1.1;\n"
+                "\n"
+                "    vWidth = widths.x * -x + widths.y;\n"
+                "    vValid = 1.0;\n"
+                "    gl_Position = vec4(x, -y, 0.0, 1.0);\n"
+                "}\n"
+;
+
+const char* spectrum_geom =
+        "#version 330 core\n"
+                "\n"
+                "layout(lines) in;\n"
+                "layout(triangle_strip, max_vertices = 4) out;\n"
+                "in vec4 vColor[];\n"
+                "in float vWidth[];\n"
+                "in float vValid[];\n"
+                "out vec4 gColor;\n"
+                "out float gEdge;\n"
+                "out float gHalfWidth;\n"
+                "uniform vec2 viewport;\n"
+                "\n"
+                "void main(void) {\n"
+                "    // instances with fewer points than the draw leave their tail unused\n"
+                "    if (vValid[0] < 0.5 || vValid[1] < 0.5) return;\n"
+                "    vec2 a = gl_in[0].gl_Position.xy * viewport;\n"
+                "    vec2 b = gl_in[1].gl_Position.xy * viewport;\n"
+                "    vec2 d = b - a;\n"
+                "    float l = length(d);\n"
+                "    vec2 n = (l > 0.0) ? vec2(-d.y, d.x) / l : vec2(0.0, 1.0);\n"
+                "    for (int i = 0; i < 2; i++) {\n"
+                "        vec2 p = (i == 0) ? a : b;\n"
+                "        float h = vWidth[i] * 0.5;\n"
+                "        float e = h + 1.0;\n"
+                "        gColor = vColor[i];\n"
+                "        gHalfWidth = h;\n"
+                "        gEdge = e;\n"
+                "        gl_Position = vec4((p + n * e) / viewport, 0.0, 1.0);\n"
+                "        EmitVertex();\n"
+                "        gColor = vColor[i];\n"
+                "        gHalfWidth = h;\n"
+                "        gEdge = -e;\n"
+                "        gl_Position = vec4((p - n * e) / viewport, 0.0, 1.0);\n"
+                "        EmitVertex();\n"
+                "    }\n"
+                "    EndPrimitive();\n"
+                "}\n"
+;
+
+const char* spectrum_frag =
+        "#version 330 core\n"
+                "\n"
+                "in vec4 gColor;\n"
+                "in float gEdge;\n"
+                "in float gHalfWidth;\n"
+                "out vec4 color;\n"
+                "\n"
+                "void main(void) {\n"
+                "    float coverage = clamp(gHalfWidth + 0.5 - abs(gEdge), 0.0, 1.0);\n"
+                "    color = vec4(gColor.rgb, gColor.a * coverage);\n"
+                "}\n"
+;
+
+GLuint create_spectrum_shader()
+{
+   return create_program( spectrum_vert, spectrum_geom, spectrum_frag );
+}
+
+#endif //CHANNELSPANNER_SPECTRUMSHADER_H
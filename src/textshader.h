@@ -3,6 +3,8 @@
 
 #include <GL/glew.h>
 
+#include "shader.h"
+
 const char* text_vert =
         "#version 330 core\n"
                 "\n"
@@ -31,25 +33,7 @@ const char* text_frag =
 
 GLuint create_shader()
 {
-   GLuint id = glCreateProgram();
-
-   GLuint v = glCreateShader( GL_VERTEX_SHADER );
-   glShaderSource( v, 1, &text_vert, NULL );
-   glCompileShader( v );
-
-   GLuint f = glCreateShader( GL_FRAGMENT_SHADER );
-   glShaderSource( f, 1, &text_frag, NULL );
-   glCompileShader( f );
-
-   glAttachShader( id, v );
-   glAttachShader( id, f );
-
-   glLinkProgram( id );
-
-   glDeleteShader( v );
-   glDeleteShader( f );
-
-   return id;
+   return create_program( text_vert, NULL, text_frag );
 }
 
-#endif //CHANNELSPANNER_TEXTSHADER_H
+#endif //CHANNELSPANNER_TEXTSHADER_H
\ No newline at end of file
@@ -1,15 +1,20 @@
 #include <cstdio>
 #include <cmath>
 #include <cassert>
+#include <ctime>
 #include <jansson.h>
 #include <X11/Xlib.h>
 #include <X11/Xos.h>
+#ifdef HAVE_XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
 
 #include "vst2.h"
 #include "logging.h"
 #include "lglw.h"
 #include "process.h"
 #include "draw.h"
+#include "resources.h"
 #include "spanner.h"
 #include "biquad.h"
 
@@ -23,6 +28,39 @@ uint FFT_SCALE_MAX = (uint)log2( MAX_FFT ) - 8;
 
 #define COLOR_MAX 6
 
+// redraws per second while nothing plays and nobody touches the editor
+#define IDLE_REDRAW_RATE 5
+// how long input keeps the editor at the display's rate after the transport stopped
+#define INPUT_HOLD_MS 1000
+
+// spectrums analysed per second at most, the editor interpolates between them
+#define ANALYSIS_RATE 60
+// a second of audio processed in less wall-clock time than this is a render faster than real time
+#define OFFLINE_SECOND_NS 500000000ull
+
+// what the editor has to do on its own thread, posted from any thread and taken by its timer
+#define EDITOR_REDRAW      1
+#define EDITOR_RESIZE      2
+#define EDITOR_SAMPLE_RATE 4
+
+/*
+ * Parameters are written by whichever thread the host uses and read by the audio and editor threads. Every access
+ * from more than one thread goes through these, they're plain loads and stores on x86 and never lock.
+ */
+template<typename T>
+static inline T load_relaxed( const T& v )
+{
+   T r;
+   __atomic_load( &v, &r, __ATOMIC_RELAXED );
+   return r;
+}
+
+template<typename T>
+static inline void store_relaxed( T& v, T value )
+{
+   __atomic_store( &v, &value, __ATOMIC_RELAXED );
+}
+
 const VstInt32 PLUGIN_VERSION = 1000;
 
 extern "C" {
@@ -53,11 +91,31 @@ public:
 
    uint32_t redraw_ival_ms = 1000 / 60;
 //   uint32_t redraw_ival_ms = 0;
+   uint32_t timer_ival_ms = 0;
+
+   // a redraw is only needed when this changes or a command asks for one
+   uint64_t drawn_updates = 0;
+   uint32_t editor_commands = EDITOR_REDRAW;
+   uint64_t last_input_ms = 0;
+   int playing = 0; // written by the audio thread
+   double analysis_due = 0; // samples until the next analysis, audio thread only
+
+   // while the host bounces, spectrums are only analysed as often as the editor could show them
+   int offline_level = 0; // the host said it renders offline
+   int offline = 0; // audio thread only, as are the following
+   uint64_t speed_since = 0; // ns, when the audio counted in speed_samples began
+   uint32_t speed_samples = 0;
+   uint64_t analysed_at = 0; // ns
+
+   int waterfall = WATERFALL_OFF;
+
+   perf_t perf = {};
+   bool hud = false;
 
    int process = 1;
    int bandpass = 0;
 
-   cascade_t filters[MAX_CHANNELS];
+   filter_bank_t filters;
 
 public:
    VSTPluginWrapper( audioMasterCallback vstHostCallback,
@@ -89,6 +147,7 @@ public:
    {
       initTrack();
       shmem = open_shared_memory();
+      acquire_resources();
       return 1;
    }
 
@@ -96,6 +155,7 @@ public:
    {
       closeEditor();
       freeCtx();
+      release_resources();
       close_shared_memory( shmem );
       freeTrack();
       if( nullptr != savedState )
@@ -105,21 +165,56 @@ public:
       }
    }
 
+   // an instance suspended for long enough may have claimed another slot since, pinned here instead of while processing
+   void lockSharedMemory()
+   {
+      lock_shared_memory( shmem );
+   }
+
    void initTrack()
    {
       if ( nullptr != track )
          freeTrack();
-      track = init_sample_data( FFT_SCALER(fftScale) );
-      track->color = color;
-      track->group = group;
+      track = init_sample_data( FFT_SCALER(load_relaxed( fftScale )) );
+      track->sampleRate = load_relaxed( sampleRate );
+      track->color = load_relaxed( color );
+      track->group = load_relaxed( group );
    }
 
    void initCtx()
    {
       if ( nullptr != ctx )
          freeCtx();
-      ctx = init_draw_ctx( windowScale, sampleRate );
+      ctx = init_draw_ctx( load_relaxed( windowScale ), load_relaxed( sampleRate ) );
+      lglw_dpi_get( lglw, &ctx->dpi );
+      set_waterfall( ctx, waterfall );
+      set_hud( ctx, hud ? &perf : nullptr );
+   }
+
+   // keeps everything drawn so far, only what depends on the window's size changes
+   void resizeCtx()
+   {
+      if ( nullptr == ctx )
+         return;
       lglw_dpi_get( lglw, &ctx->dpi );
+      resize_draw_ctx( ctx, load_relaxed( windowScale ), editor_rect.right, editor_rect.bottom );
+   }
+
+   // on the editor's thread, after the Scale parameter changed; the host may have fetched the new rect already, so
+   // what the window was last sized for is the draw context's scale
+   void resizeEditor()
+   {
+      uint8_t scale = load_relaxed( windowScale );
+      if ( nullptr == ctx || ctx->scale == scale )
+         return;
+
+      editor_rect.left = 0;
+      editor_rect.top = 0;
+      editor_rect.right = (VstInt16) (EDITWIN_W * scale);
+      editor_rect.bottom = (VstInt16) (EDITWIN_H * scale);
+
+      (void) lglw_window_resize( lglw, editor_rect.right, editor_rect.bottom );
+      resizeCtx();
    }
 
    void freeTrack()
@@ -138,12 +233,174 @@ public:
 
    void updateTrack()
    {
-      process_samples( track, reactivity );
+      uint64_t start = perf_now();
+      process_samples( track, load_relaxed( reactivity ) );
+      uint64_t processed = perf_now();
       update_shared_memory( shmem, track );
+      perf_add( &perf.fft, processed - start );
+      perf_add( &perf.copy, perf_now() - processed );
+   }
+
+   static uint64_t now_ms()
+   {
+      struct timespec cl;
+      clock_gettime( CLOCK_MONOTONIC, &cl );
+      return (uint64_t) cl.tv_sec * 1000 + (uint64_t) cl.tv_nsec / 1000000;
+   }
+
+   static uint32_t display_refresh_rate()
+   {
+      uint32_t rate = 60;
+#ifdef HAVE_XRANDR
+      Display* display = XOpenDisplay( nullptr );
+      if ( nullptr != display )
+      {
+         XRRScreenConfiguration* config = XRRGetScreenInfo( display, DefaultRootWindow( display ) );
+         if ( nullptr != config )
+         {
+            short current = XRRConfigCurrentRate( config );
+            if ( current > 0 )
+               rate = (uint32_t) current;
+            XRRFreeScreenConfigInfo( config );
+         }
+         XCloseDisplay( display );
+      }
+#endif
+      return rate;
+   }
+
+   void post( uint32_t commands )
+   {
+      __atomic_fetch_or( &editor_commands, commands, __ATOMIC_RELEASE );
+   }
+
+   // something the editor shows changed other than the spectrums
+   void invalidate()
+   {
+      post( EDITOR_REDRAW );
+   }
+
+   // the audio thread takes the parameters over at the start of every block, the band-pass takes its own
+   void applyParameters()
+   {
+      track->sampleRate = load_relaxed( sampleRate );
+      track->group = load_relaxed( group );
+      track->color = load_relaxed( color );
+   }
+
+   int queryProcessLevel()
+   {
+      return kVstProcessLevelOffline == _vstHostCallback( &_vstPlugin, audioMasterGetCurrentProcessLevel, 0, 0, nullptr, 0 );
+   }
+
+   /*
+    * The host renders offline when it says so, or when a second of audio took less than OFFLINE_SECOND_NS to process.
+    * Both are checked once per second of audio, so the host is asked for its process level only that often.
+    */
+   void checkSpeed( uint32_t sampleFrames, uint64_t now )
+   {
+      if ( speed_samples >= (uint32_t) track->sampleRate )
+      {
+         int fast = 0 != speed_since && now - speed_since < OFFLINE_SECOND_NS;
+         store_relaxed( offline_level, queryProcessLevel() );
+         offline = fast || load_relaxed( offline_level );
+         speed_since = 0;
+         speed_samples = 0;
+      }
+      else
+      {
+         offline = offline || load_relaxed( offline_level );
+      }
+
+      if ( 0 == speed_since )
+         speed_since = now;
+      speed_samples += sampleFrames;
+   }
+
+   /*
+    * Analyses and publishes the spectrum at ANALYSIS_RATE, instead of after every block however short. While the host
+    * renders offline that's ANALYSIS_RATE per second of wall-clock time instead, as only the editor needs spectrums.
+    */
+   void analyse( uint32_t sampleFrames, uint64_t now )
+   {
+      checkSpeed( sampleFrames, now );
+
+      if ( offline )
+      {
+         if ( now - analysed_at < 1000000000ull / ANALYSIS_RATE )
+            return;
+         analysed_at = now;
+         updateTrack();
+         return;
+      }
+
+      analysis_due -= sampleFrames;
+      if ( analysis_due > 0 )
+         return;
+
+      // the overshoot carries over, so analyses average ANALYSIS_RATE whatever the block size; a block longer than a
+      // whole period still only analyses once
+      double period = track->sampleRate / ANALYSIS_RATE;
+      analysis_due += period;
+      if ( analysis_due <= 0 )
+         analysis_due = period;
+      updateTrack();
+   }
+
+   void checkTransport()
+   {
+      auto* time = (VstTimeInfo*) _vstHostCallback( &_vstPlugin, audioMasterGetTime, 0, 0, nullptr, 0 );
+      int now = (nullptr != time && 0 != (time->flags & kVstTransportPlaying)) ? 1 : 0;
+      __atomic_store_n( &playing, now, __ATOMIC_RELAXED );
+   }
+
+   /*
+    * Called by the timer: only redraws when a track of the group was updated or the editor was invalidated, and
+    * slows the timer down to an idle rate while the editor is hidden, or the transport is stopped and nobody uses it.
+    */
+   void redrawIfNeeded()
+   {
+      if ( nullptr == ctx ) return;
+
+      uint32_t commands = __atomic_exchange_n( &editor_commands, 0, __ATOMIC_ACQUIRE );
+      if ( commands & EDITOR_RESIZE )
+         resizeEditor();
+      if ( commands & EDITOR_SAMPLE_RATE )
+         set_sample_rate( ctx, load_relaxed( sampleRate ) );
+
+      // a hidden editor only has to notice it was shown again, the next tick after that picks the rate back up
+      int visible = lglw_window_is_visible( lglw );
+      int active = visible && __atomic_load_n( &playing, __ATOMIC_RELAXED ) && 1 == load_relaxed( process );
+      active = active || (visible && (now_ms() - last_input_ms) < INPUT_HOLD_MS);
+
+      uint32_t ival = active ? redraw_ival_ms : 1000 / IDLE_REDRAW_RATE;
+      if ( ival != timer_ival_ms )
+      {
+         timer_ival_ms = ival;
+         lglw_timer_start( lglw, timer_ival_ms );
+      }
+
+      if ( !visible )
+      {
+         post( commands & EDITOR_REDRAW );
+         return;
+      }
+
+      uint64_t updates = group_updates( shmem, load_relaxed( group ) );
+      // the HUD's timings keep changing, and so do the spectrums until they reached the last published ones
+      if ( hud || ctx->interpolating ) commands |= EDITOR_REDRAW;
+      if ( 0 == (commands & EDITOR_REDRAW) && updates == drawn_updates ) return;
+
+      drawn_updates = updates;
+      lglw_redraw( lglw );
    }
 
    void openEditor( void* wnd )
    {
+      // the Scale may have changed while the editor was closed
+      editor_rect.right = (VstInt16) (EDITWIN_W * load_relaxed( windowScale ));
+      editor_rect.bottom = (VstInt16) (EDITWIN_H * load_relaxed( windowScale ));
+
       if ( nullptr == lglw )
       {
          lglw = lglw_init( editor_rect.right, editor_rect.bottom );
@@ -160,7 +417,15 @@ public:
       lglw_timer_callback_set( lglw, &loc_timer_cbk );
       lglw_redraw_callback_set( lglw, &loc_redraw_cbk );
 
-      lglw_timer_start( lglw, redraw_ival_ms );
+      uint32_t rate = display_refresh_rate();
+      DEBUG_PRINT( "Redrawing at up to %u Hz\n", rate );
+      redraw_ival_ms = 1000 / rate;
+      timer_ival_ms = redraw_ival_ms;
+      // the new draw context already has the current size and sample rate, only a redraw is left to do
+      __atomic_store_n( &editor_commands, EDITOR_REDRAW, __ATOMIC_RELEASE );
+      last_input_ms = now_ms();
+
+      lglw_timer_start( lglw, timer_ival_ms );
    }
 
    void closeEditor()
@@ -178,7 +443,9 @@ public:
       // Save host GL context
       lglw_glcontext_push( lglw );
 
+      uint64_t start = perf_now();
       draw( ctx, track, shmem );
+      perf_add( &perf.draw, perf_now() - start );
 
       lglw_swap_buffers( lglw );
 
@@ -188,21 +455,47 @@ public:
 
    void setMousePosition( int32_t x, int32_t y )
    {
+      last_input_ms = now_ms();
+      invalidate();
+
       set_mouse( ctx, x, y );
       float freq = expf( (ctx->mousex + 1) / ctx->sx ) / ctx->ox;
-      for ( auto& filter : filters )
-         update_cascade( &filter, freq / sampleRate, (1.1f + ctx->mousey) * 3.0f );
+      set_filter_bank_target( &filters, freq / load_relaxed( sampleRate ), (1.1f + ctx->mousey) * 3.0f );
    }
 
-   void setSampleRate( float _rate )
+   // 'w' shows or hides the waterfall, 'g' adds or removes the group members in it, 'h' shows or hides the HUD
+   bool keyPressed( uint32_t key )
    {
-      sampleRate = _rate;
-
-      if ( nullptr != ctx )
+      switch ( key )
       {
-         ctx->sr = sampleRate;
-         ctx->fm = sampleRate / 2.0f;
+      default:
+         return false;
+      case 'h':
+      case 'H':
+         hud = !hud;
+         set_hud( ctx, hud ? &perf : nullptr );
+         invalidate();
+         return true;
+      case 'w':
+      case 'W':
+         waterfall = (WATERFALL_OFF == waterfall) ? WATERFALL_TRACK : WATERFALL_OFF;
+         break;
+      case 'g':
+      case 'G':
+         if ( WATERFALL_OFF == waterfall ) return false;
+         waterfall = (WATERFALL_TRACK == waterfall) ? WATERFALL_GROUP : WATERFALL_TRACK;
+         break;
       }
+
+      set_waterfall( ctx, waterfall );
+      invalidate();
+      return true;
+   }
+
+   void setSampleRate( float _rate )
+   {
+      store_relaxed( sampleRate, _rate );
+      post( EDITOR_SAMPLE_RATE | EDITOR_REDRAW );
    }
 
    float getParameter( int uniqueParamId )
@@ -213,20 +506,22 @@ public:
          DEBUG_PRINT( "Unused Parameter Request: %i\n", uniqueParamId );
          return 0;
       case 0:
-         return (float) fftScale / FFT_SCALE_MAX;
+         return (float) load_relaxed( fftScale ) / FFT_SCALE_MAX;
       case 1:
-         return sqrtf( reactivity );
+         return sqrtf( load_relaxed( reactivity ) );
       case 2:
-         return (float) (group - 1) / (MAX_INSTANCES - 1);
+         return (float) (load_relaxed( group ) - 1) / (MAX_INSTANCES - 1);
       case 3:
-         return (float) color / COLOR_MAX;
+         return (float) load_relaxed( color ) / COLOR_MAX;
       case 4:
-         return (float) (windowScale - 1) / RESOLUTION_MAX;
+         return (float) (load_relaxed( windowScale ) - 1) / RESOLUTION_MAX;
       }
    }
 
    void setParameter( int uniqueParamId, float value )
    {
+      invalidate();
+
       switch ( uniqueParamId )
       {
       default:
@@ -234,43 +529,25 @@ public:
          break;
       case 0:
       {
-         fftScale = (uint8_t) roundf( value * FFT_SCALE_MAX );
+         uint8_t scale = (uint8_t) roundf( value * FFT_SCALE_MAX );
+         store_relaxed( fftScale, scale );
+         request_frame_size( track, FFT_SCALER(scale) );
          break;
       }
       case 1:
-         reactivity = value * value;
+         store_relaxed( reactivity, value * value );
          break;
       case 2:
-      {
-         group = (uint8_t) (roundf( value * (MAX_INSTANCES - 1) ) + 1);
-         if ( nullptr != track )
-            track->group = group;
+         store_relaxed( group, (uint8_t) (roundf( value * (MAX_INSTANCES - 1) ) + 1) );
          break;
-      }
       case 3:
-      {
-         color = (uint8_t) roundf( value * COLOR_MAX );
-         if ( nullptr != track )
-            track->color = color;
+         store_relaxed( color, (uint8_t) roundf( value * COLOR_MAX ) );
          break;
-      }
       case 4:
-      {
-         windowScale = (uint8_t) roundf( value * (RESOLUTION_MAX - 1) + 1 );
-         if ( editor_rect.bottom != EDITWIN_H * windowScale)
-         {
-            editor_rect.left = 0;
-            editor_rect.top = 0;
-            editor_rect.right = (VstInt16) (EDITWIN_W * windowScale);
-            editor_rect.bottom = (VstInt16) (EDITWIN_H * windowScale);
-
-            freeCtx();
-            (void) lglw_window_resize( lglw, editor_rect.right, editor_rect.bottom );
-            initCtx();
-         }
+         store_relaxed( windowScale, (uint8_t) roundf( value * (RESOLUTION_MAX - 1) + 1 ) );
+         post( EDITOR_RESIZE );
          break;
       }
-      }
    }
 
    void getParameterName( int uniqueParamId, char* s, size_t sMaxLen )
@@ -306,19 +583,19 @@ public:
          DEBUG_PRINT( "Unused Parameter Value Request: %i\n", uniqueParamId );
          break;
       case 0:
-         ::snprintf( s, sMaxLen, "%i", FFT_SCALER(fftScale) );
+         ::snprintf( s, sMaxLen, "%i", FFT_SCALER(load_relaxed( fftScale )) );
          break;
       case 1:
-         ::snprintf( s, sMaxLen, "%.2f", reactivity );
+         ::snprintf( s, sMaxLen, "%.2f", load_relaxed( reactivity ) );
          break;
       case 2:
-         ::snprintf( s, sMaxLen, "%i", group );
+         ::snprintf( s, sMaxLen, "%i", load_relaxed( group ) );
          break;
       case 3:
-         ::snprintf( s, sMaxLen, "%i", color );
+         ::snprintf( s, sMaxLen, "%i", load_relaxed( color ) );
          break;
       case 4:
-         ::snprintf( s, sMaxLen, "%i", windowScale );
+         ::snprintf( s, sMaxLen, "%i", load_relaxed( windowScale ) );
          break;
       }
    }
@@ -450,19 +727,19 @@ public:
 
       json_t* rootJ = json_object();
 
-      json_t* fts = json_integer( fftScale );
+      json_t* fts = json_integer( load_relaxed( fftScale ) );
       json_object_set_new( rootJ, "fftScale", fts );
 
-      json_t* rct = json_real( reactivity );
+      json_t* rct = json_real( load_relaxed( reactivity ) );
       json_object_set_new( rootJ, "reactivity", rct );
 
-      json_t* col = json_integer( color );
+      json_t* col = json_integer( load_relaxed( color ) );
       json_object_set_new( rootJ, "color", col );
 
-      json_t* wns = json_integer( windowScale );
+      json_t* wns = json_integer( load_relaxed( windowScale ) );
       json_object_set_new( rootJ, "windowScale", wns );
 
-      json_t* grp = json_integer( group );
+      json_t* grp = json_integer( load_relaxed( group ) );
       json_object_set_new( rootJ, "group", grp );
 
       savedState = json_dumps( rootJ, JSON_INDENT( 2 ) | JSON_REAL_PRECISION( 4 ) );
@@ -490,27 +767,29 @@ public:
 
          {
             json_t* fts = json_object_get( rootJ, "fftScale" );
-            if ( fts ) fftScale = uint8_t( json_number_value( fts ) );
+            if ( fts ) store_relaxed( fftScale, uint8_t( json_number_value( fts ) ) );
          }
 
          {
             json_t* rct = json_object_get( rootJ, "reactivity" );
-            if ( rct ) reactivity = float( json_number_value( rct ) );
+            if ( rct ) store_relaxed( reactivity, float( json_number_value( rct ) ) );
          }
 
          {
             json_t* col = json_object_get( rootJ, "color" );
-            if ( col ) color = uint8_t( json_number_value( col ) );
+            if ( col ) store_relaxed( color, uint8_t( json_number_value( col ) ) );
          }
 
          {
             json_t* wns = json_object_get( rootJ, "windowScale" );
-            if ( wns ) windowScale = uint8_t( json_number_value( wns ) );
+            if ( wns ) store_relaxed( windowScale, uint8_t( json_number_value( wns ) ) );
          }
 
          {
             json_t* grp = json_object_get( rootJ, "group" );
-            if ( grp ) group = uint8_t( json_number_value( grp ) );
+            // a group outside 1..MAX_INSTANCES would index past the members in the Shared Memory
+            if ( grp )
+               store_relaxed( group, uint8_t( fmin( fmax( json_number_value( grp ), 1 ), MAX_INSTANCES ) ) );
          }
 
          json_decref( rootJ );
@@ -523,10 +802,11 @@ public:
          r = 0;
       }
 
+      // hosts restore state from any thread while processing, so the track and editor pick it up on their own
       if ( r == 1 )
       {
-         initTrack();
-         initCtx();
+         request_frame_size( track, FFT_SCALER(load_relaxed( fftScale )) );
+         post( EDITOR_RESIZE | EDITOR_REDRAW );
       }
       return r;
    }
@@ -551,31 +831,39 @@ extern "C" {
 void VSTPluginProcessSamplesFloat32( AEffect* vstPlugin, float** inputs, float** outputs, VstInt32 sampleFrames )
 {
    auto* wrapper = static_cast<VSTPluginWrapper*>(vstPlugin->object);
+   uint64_t start = perf_now();
 //   DEBUG_PRINT( "Processing %i sample frames for %i inputs (max %i)\n", sampleFrames, wrapper->getNumInputs(), MAX_CHANNELS );
 
    track_t* track = wrapper->getTrack();
 
-   update_frame_size( track, FFT_SCALER( wrapper->fftScale ) );
+   adopt_working_area( track );
+   wrapper->applyParameters();
+
+   int process = load_relaxed( wrapper->process );
+   int filtering = 1 == process && 1 == load_relaxed( wrapper->bandpass );
+
+   int channels = wrapper->getNumInputs() < MAX_CHANNELS ? wrapper->getNumInputs() : MAX_CHANNELS;
+   if ( filtering )
+      process_filter_bank( &wrapper->filters, inputs, outputs, (size_t) channels, (size_t) sampleFrames );
 
-   for ( int i = 0; i < wrapper->getNumInputs() && i < MAX_CHANNELS; ++i )
+   for ( int i = 0; i < channels; ++i )
    {
       auto inputSamples = inputs[i];
       auto outputSamples = outputs[i];
 
-      if ( nullptr != inputSamples && nullptr != outputSamples && inputSamples != outputSamples )
-      {
-         if ( 1 == wrapper->process && 1 == wrapper->bandpass )
-            process_cascade( &wrapper->filters[i], inputSamples, outputSamples, (size_t) sampleFrames );
-         else
-            memcpy( outputSamples, inputSamples, (size_t) sampleFrames * sizeof( float ) );
-      }
+      if ( !filtering && nullptr != inputSamples && nullptr != outputSamples && inputSamples != outputSamples )
+         memcpy( outputSamples, inputSamples, (size_t) sampleFrames * sizeof( float ) );
 
-      if ( 1 == wrapper->process )
+      if ( 1 == process )
          add_sample_data( track, (size_t) i, outputSamples, (size_t) sampleFrames );
    }
 
-   if ( 1 == wrapper->process )
-      wrapper->updateTrack();
+   if ( 1 == process )
+      wrapper->analyse( (uint32_t) sampleFrames, start );
+
+   wrapper->checkTransport();
+
+   perf_add( &wrapper->perf.process, perf_now() - start );
 }
 }
 
@@ -734,7 +1022,9 @@ VSTPluginDispatcher( AEffect* vstPlugin, VstInt32 opCode, VstInt32 index, VstInt
 
    case effMainsChanged:
       DEBUG_PRINT( "effMainsChanged\n" );
-      wrapper->process = ( value == 0 ) ? 0 : 1;
+      store_relaxed( wrapper->process, ( value == 0 ) ? 0 : 1 );
+      if ( 0 != value )
+         wrapper->lockSharedMemory();
       r = 1;
       break;
 
@@ -788,13 +1078,15 @@ VSTPluginDispatcher( AEffect* vstPlugin, VstInt32 opCode, VstInt32 index, VstInt
 
    case effStartProcess:
       DEBUG_PRINT( "effStartProcess\n" );
-      wrapper->process = 1;
+      store_relaxed( wrapper->process, 1 );
+      store_relaxed( wrapper->offline_level, wrapper->queryProcessLevel() );
       r = 1;
       break;
 
    case effStopProcess:
       DEBUG_PRINT( "effStopProcess\n" );
-      wrapper->process = 0;
+      store_relaxed( wrapper->process, 0 );
+      store_relaxed( wrapper->offline_level, 0 );
       r = 1;
       break;
 
@@ -821,8 +1113,8 @@ VSTPluginDispatcher( AEffect* vstPlugin, VstInt32 opCode, VstInt32 index, VstInt
       {
          wrapper->editor_rect.left = 0;
          wrapper->editor_rect.top = 0;
-         wrapper->editor_rect.right = (VstInt16)(EDITWIN_W * wrapper->windowScale);
-         wrapper->editor_rect.bottom = (VstInt16)(EDITWIN_H * wrapper->windowScale);
+         wrapper->editor_rect.right = (VstInt16)(EDITWIN_W * load_relaxed( wrapper->windowScale ));
+         wrapper->editor_rect.bottom = (VstInt16)(EDITWIN_H * load_relaxed( wrapper->windowScale ));
          *(void**) ptr = (void*) &wrapper->editor_rect;
          r = 1;
       }
@@ -914,7 +1206,7 @@ static void loc_mouse_cbk( lglw_t _lglw, int32_t _x, int32_t _y, uint32_t _butto
    (void)_buttonState;
    (void)_changedButtonState;
    auto* wrapper = (VSTPluginWrapper*) lglw_userdata_get( _lglw );
-   wrapper->bandpass = ( LGLW_MOUSE_LBUTTON == _buttonState ) ? 1 : 0;
+   store_relaxed( wrapper->bandpass, ( LGLW_MOUSE_LBUTTON == _buttonState ) ? 1 : 0 );
    wrapper->setMousePosition( _x, _y );
 }
 
@@ -924,23 +1216,24 @@ static void loc_focus_cbk( lglw_t _lglw, uint32_t _focusState, uint32_t _changed
    if ( _focusState == 0 )
    {
       auto* wrapper = (VSTPluginWrapper*) lglw_userdata_get( _lglw );
-      wrapper->bandpass = 0;
+      store_relaxed( wrapper->bandpass, 0 );
       wrapper->setMousePosition( 0, 0 );
    }
 }
 
 static lglw_bool_t loc_keyboard_cbk( lglw_t _lglw, uint32_t _vkey, uint32_t _kmod, lglw_bool_t _bPressed )
 {
-   (void)_lglw;
-   (void)_vkey;
    (void)_kmod;
-   (void)_bPressed;
-   return LGLW_FALSE;
+   if ( !_bPressed ) return LGLW_FALSE;
+
+   auto* wrapper = (VSTPluginWrapper*) lglw_userdata_get( _lglw );
+   return wrapper->keyPressed( _vkey ) ? LGLW_TRUE : LGLW_FALSE;
 }
 
 static void loc_timer_cbk( lglw_t _lglw )
 {
-   lglw_redraw( _lglw );
+   auto* wrapper = (VSTPluginWrapper*) lglw_userdata_get( _lglw );
+   wrapper->redrawIfNeeded();
 }
 
 static void loc_redraw_cbk( lglw_t _lglw )
@@ -1019,10 +1312,12 @@ VSTPluginMain( audioMasterCallback
    static_assert( MAX_FFT % 256 == 0, "MAX_FFT must be divisible by 256" );
    static_assert( MAX_CHANNELS > 0, "MAX_CHANNELS must be > 0" );
    static_assert( MAX_INSTANCES > 0, "MAX_INSTANCES must be > 0" );
+   static_assert( MAX_SEGMENTS > 0, "MAX_SEGMENTS must be > 0" );
 
    DEBUG_PRINT( " Max FFT Size: %i\n", MAX_FFT );
    DEBUG_PRINT( " Max Channels: %i\n", MAX_CHANNELS );
    DEBUG_PRINT( "Max Instances: %i\n", MAX_INSTANCES );
+   DEBUG_PRINT( " Max Segments: %i\n", MAX_SEGMENTS );
 
    auto* plugin =
            new VSTPluginWrapper( vstHostCallback,
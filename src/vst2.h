@@ -15,6 +15,7 @@ typedef VstInt64 VstIntPtr;
 #define kVstMaxParamStrLen 8
 #define kVstMaxProductStrLen kVstMaxVendorStrLen
 #define kPlugCategAnalysis 3
+#define kVstProcessLevelOffline 4
 
 #else
 #include "aeffect.h"
@@ -0,0 +1,59 @@
+#ifndef CHANNELSPANNER_WATERFALLSHADER_H
+#define CHANNELSPANNER_WATERFALLSHADER_H
+
+#include <GL/glew.h>
+
+#include "shader.h"
+
+/*
+ * The waterfall covers the window with the history of one spectrum, newest at the top. The history is a ring of
+ * rows of raw magnitudes in linear bins, so the fragment stage maps the window to log frequency, dB and a colour,
+ * and scrolls by where the newest row is.
+ */
+
+const char* waterfall_vert =
+        "#version 330 core\n"
+                "\n"
+                "out vec2 position;\n"
+                "\n"
+                "void main(void) {\n"
+                "    position = vec2((gl_VertexID & 1) * 2 - 1, (gl_VertexID & 2) - 1);\n"
+                "    gl_Position = vec4(position, 0.0, 1.0);\n"
+                "}\n"
+;
+
+const char* waterfall_frag =
+        "#version 330 core\n"
+                "\n"
+                "in vec2 position;\n"
+                "out vec4 color;\n"
+                "uniform sampler2D history;\n"
+                "uniform vec4 mapping;\n" // sx, sy, ox, oy
+                "uniform float hz;\n" // frequency step between bins
+                "uniform float bins;\n"
+                "uniform float head;\n" // center of the newest row
+                "uniform float span;\n" // from the newest to the oldest row
+                "\n"
+                "vec3 colormap(float l) {\n"
+                "    vec3 c = mix(vec3(0.114, 0.122, 0.129), vec3(0.314, 0.353, 0.545), smoothstep(0.0, 0.35, l));\n"
+                "    c = mix(c, vec3(0.627, 0.224, 0.506), smoothstep(0.35, 0.6, l));\n"
+                "    c = mix(c, vec3(0.902, 0.435, 0.294), smoothstep(0.6, 0.8, l));\n"
+                "    return mix(c, vec3(0.678, 0.675, 0.400), smoothstep(0.8, 1.0, l));\n"
+                "}\n"
+                "\n"
+                "void main(void) {\n"
+                "    float f = exp((position.x + 1.0) / mapping.x) / mapping.z;\n"
+                "    float u = (f / hz + 0.5) / bins;\n"
+                "    float v = head - (1.0 - position.y) * 0.5 * span;\n"
+                "    float gain = texture(history, vec2(u, v)).r;\n"
+                "    float level = clamp(-0.5 * mapping.y * log(max(gain, 1e-20) * mapping.w), 0.0, 1.0);\n"
+                "    color = vec4(colormap(level), 0.8 * smoothstep(0.05, 0.6, level));\n"
+                "}\n"
+;
+
+GLuint create_waterfall_shader()
+{
+   return create_program( waterfall_vert, NULL, waterfall_frag );
+}
+
+#endif //CHANNELSPANNER_WATERFALLSHADER_H
@@ -0,0 +1,635 @@
+
+#define _GNU_SOURCE
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "process.h"
+#include "perf.h"
+
+#define ANALYSIS_MAGIC 0x41505343 /* "CSPA" */
+#define ANALYSIS_VERSION 1
+
+/* segments shorter than this aren't worth a thread of their own */
+#define MIN_SEGMENT_FRAMES 64
+/* smoothing is continued from this far back at the start of a segment, in how much of a spectrum is left over */
+#define SMOOTHING_FORGOTTEN 1e-6
+
+/*
+ * Analyses WAV or raw PCM files with the plugin's own analysis, without a host.
+ *
+ * The file is mapped and split into one segment of consecutive spectrums per thread. Every thread analyses its
+ * segment with its own tracks, starting a frame early so every spectrum sees exactly the samples it would in one pass.
+ * Files with more channels than a track has are spread over several tracks.
+ *
+ * In binary, the output is this header followed by `rows` spectrums of every channel, each of `bins` floats.
+ */
+typedef struct {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t mode;
+   uint32_t channels;
+   uint32_t frameSize;
+   uint32_t hop;
+   uint32_t bins;
+   float sampleRate;
+   uint64_t rows;
+} analysis_header_t;
+
+typedef enum {
+   MODE_AVERAGE,
+   MODE_PEAK,
+   MODE_FRAMES
+} analysis_mode_t;
+
+typedef enum {
+   FORMAT_S16,
+   FORMAT_S24,
+   FORMAT_S32,
+   FORMAT_F32
+} sample_format_t;
+
+typedef struct {
+   const uint8_t* data;
+   size_t frames;    /* sample frames */
+   int channels;
+   float sampleRate;
+   sample_format_t format;
+   size_t width;     /* bytes per sample */
+} pcm_t;
+
+typedef struct {
+   const pcm_t* pcm;
+   analysis_mode_t mode;
+   size_t frameSize;
+   size_t hop;
+   size_t bins;
+   float reactivity;
+   int decibels;
+   int binary;
+   size_t warmup;    /* frames analysed before a segment to continue the smoothing */
+
+   size_t first;     /* spectrums of this segment */
+   size_t last;
+
+   double* sum;      /* channels x bins */
+   float* peak;      /* channels x bins */
+   FILE* rows;       /* spectrums of MODE_FRAMES, in the output format */
+   int threaded;
+   int failed;
+} segment_t;
+
+static uint16_t read_u16( const uint8_t* p )
+{
+   return (uint16_t) (p[0] | p[1] << 8);
+}
+
+static uint32_t read_u32( const uint8_t* p )
+{
+   return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static int set_format( pcm_t* pcm, int isFloat, int bits )
+{
+   if ( isFloat && 32 == bits )
+      pcm->format = FORMAT_F32;
+   else if ( !isFloat && 16 == bits )
+      pcm->format = FORMAT_S16;
+   else if ( !isFloat && 24 == bits )
+      pcm->format = FORMAT_S24;
+   else if ( !isFloat && 32 == bits )
+      pcm->format = FORMAT_S32;
+   else
+      return 0;
+
+   pcm->width = (size_t) bits / 8;
+   return 1;
+}
+
+/* finds the format and samples in a RIFF WAVE file, a data chunk running past the end of the file is cut short */
+static int parse_wav( pcm_t* pcm, const uint8_t* map, size_t size )
+{
+   if ( size < 12 || 0 != memcmp( map, "RIFF", 4 ) || 0 != memcmp( map + 8, "WAVE", 4 ) )
+      return 0;
+
+   int haveFormat = 0;
+   for ( size_t p = 12; p + 8 <= size; )
+   {
+      uint32_t length = read_u32( map + p + 4 );
+      const uint8_t* chunk = map + p + 8;
+      size_t available = size - p - 8;
+
+      if ( 0 == memcmp( map + p, "fmt ", 4 ) && length >= 16 && available >= 16 )
+      {
+         uint16_t tag = read_u16( chunk );
+         /* WAVE_FORMAT_EXTENSIBLE keeps the actual format in the first two bytes of its sub-format */
+         if ( 0xFFFE == tag && length >= 40 && available >= 40 )
+            tag = read_u16( chunk + 24 );
+
+         pcm->channels = read_u16( chunk + 2 );
+         pcm->sampleRate = (float) read_u32( chunk + 4 );
+         if ( (1 != tag && 3 != tag) || !set_format( pcm, 3 == tag, read_u16( chunk + 14 ) ) )
+         {
+            fprintf( stderr, "Unsupported WAV format %u with %u bits\n", tag, read_u16( chunk + 14 ) );
+            return -1;
+         }
+         /* the frame size divides the data chunk, so neither may be zero */
+         if ( 0 == pcm->channels || 0 == pcm->width )
+         {
+            fprintf( stderr, "WAV file has %i channels of %zu bytes\n", pcm->channels, pcm->width );
+            return -1;
+         }
+         haveFormat = 1;
+      }
+      else if ( 0 == memcmp( map + p, "data", 4 ) && haveFormat )
+      {
+         size_t bytes = (length < available) ? length : available;
+         pcm->data = chunk;
+         pcm->frames = bytes / (pcm->width * (size_t) pcm->channels);
+         return 1;
+      }
+
+      p += 8 + (size_t) length + (length & 1);
+   }
+
+   fprintf( stderr, "No samples found in the WAV file\n" );
+   return -1;
+}
+
+/* `count` samples of one channel from `first` on, those before the start or past the end are silence */
+static void read_samples( const pcm_t* pcm, int channel, int64_t first, size_t count, float* out )
+{
+   size_t stride = pcm->width * (size_t) pcm->channels;
+
+   for ( size_t i = 0; i < count; i++ )
+   {
+      int64_t f = first + (int64_t) i;
+      if ( f < 0 || f >= (int64_t) pcm->frames )
+      {
+         out[i] = 0;
+         continue;
+      }
+
+      const uint8_t* p = pcm->data + (size_t) f * stride + (size_t) channel * pcm->width;
+      switch ( pcm->format )
+      {
+      case FORMAT_S16:
+         out[i] = (int16_t) read_u16( p ) / 32768.0f;
+         break;
+      case FORMAT_S24:
+         out[i] = (float) ((int32_t) ((uint32_t) p[0] << 8 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 24) >> 8) / 8388608.0f;
+         break;
+      case FORMAT_S32:
+         out[i] = (float) ((int32_t) read_u32( p ) / 2147483648.0);
+         break;
+      case FORMAT_F32:
+         memcpy( &out[i], p, sizeof( float ) );
+         break;
+      }
+   }
+}
+
+static float output_value( const segment_t* s, float magnitude )
+{
+   return s->decibels ? 20.0f * log10f( fmaxf( magnitude, 1e-12f ) ) : magnitude;
+}
+
+static void write_row( FILE* f, const segment_t* s, size_t frame, int channel, const float* spectrum )
+{
+   if ( s->binary )
+   {
+      float row[MAX_FFT / 2 + 1];
+      for ( size_t i = 0; i < s->bins; i++ )
+         row[i] = output_value( s, spectrum[i] );
+      fwrite( row, sizeof( float ), s->bins, f );
+      return;
+   }
+
+   fprintf( f, "%zu,%.6f,%i", frame, (double) ((frame + 1) * s->hop) / s->pcm->sampleRate, channel );
+   for ( size_t i = 0; i < s->bins; i++ )
+      fprintf( f, ",%g", output_value( s, spectrum[i] ) );
+   fputc( '\n', f );
+}
+
+static void* analyse_segment( void* arg )
+{
+   segment_t* s = arg;
+   const pcm_t* pcm = s->pcm;
+   int tracks = (pcm->channels + MAX_CHANNELS - 1) / MAX_CHANNELS;
+
+   track_t** t = calloc( (size_t) tracks, sizeof( track_t* ) );
+   float* samples = malloc( s->frameSize * sizeof( float ) );
+   if ( MODE_FRAMES == s->mode )
+      s->rows = tmpfile();
+   if ( NULL == t || NULL == samples || (MODE_FRAMES == s->mode && NULL == s->rows) )
+   {
+      fprintf( stderr, "Unable to set up the analysis of spectrums %zu to %zu: %s\n", s->first, s->last, strerror( errno ) );
+      s->failed = 1;
+      free( samples );
+      free( t );
+      return NULL;
+   }
+
+   for ( int k = 0; k < tracks; k++ )
+   {
+      t[k] = init_sample_data( s->frameSize );
+      t[k]->sampleRate = pcm->sampleRate;
+   }
+
+   /* spectrum n is of the frame ending after hop n + 1, one frame of samples before the first goes in up front */
+   size_t start = (s->first > s->warmup) ? s->first - s->warmup : 0;
+   int64_t end = (int64_t) (start * s->hop);
+
+   for ( int c = 0; c < pcm->channels; c++ )
+   {
+      read_samples( pcm, c, end - (int64_t) s->frameSize, s->frameSize, samples );
+      add_sample_data( t[c / MAX_CHANNELS], (size_t) (c % MAX_CHANNELS), samples, s->frameSize );
+   }
+
+   for ( size_t n = start; n < s->last; n++ )
+   {
+      for ( int c = 0; c < pcm->channels; c++ )
+      {
+         read_samples( pcm, c, end, s->hop, samples );
+         add_sample_data( t[c / MAX_CHANNELS], (size_t) (c % MAX_CHANNELS), samples, s->hop );
+      }
+      end += (int64_t) s->hop;
+
+      for ( int k = 0; k < tracks; k++ )
+         process_samples( t[k], s->reactivity );
+
+      if ( n < s->first )
+         continue;
+
+      for ( int c = 0; c < pcm->channels; c++ )
+      {
+         const float* fft = t[c / MAX_CHANNELS]->channels[c % MAX_CHANNELS].fft;
+         switch ( s->mode )
+         {
+         case MODE_AVERAGE:
+            for ( size_t i = 0; i < s->bins; i++ )
+               s->sum[(size_t) c * s->bins + i] += fft[i];
+            break;
+         case MODE_PEAK:
+            for ( size_t i = 0; i < s->bins; i++ )
+               s->peak[(size_t) c * s->bins + i] = fmaxf( s->peak[(size_t) c * s->bins + i], fft[i] );
+            break;
+         case MODE_FRAMES:
+            write_row( s->rows, s, n, c, fft );
+            break;
+         }
+      }
+   }
+
+   for ( int k = 0; k < tracks; k++ )
+      free_sample_data( t[k] );
+   free( samples );
+   free( t );
+
+   if ( NULL != s->rows && (0 != fflush( s->rows ) || ferror( s->rows )) )
+   {
+      fprintf( stderr, "Unable to keep the spectrums %zu to %zu: %s\n", s->first, s->last, strerror( errno ) );
+      s->failed = 1;
+   }
+   return NULL;
+}
+
+static int copy_rows( FILE* from, FILE* to )
+{
+   char buffer[1 << 16];
+   rewind( from );
+   size_t n;
+   while ( 0 < (n = fread( buffer, 1, sizeof( buffer ), from )) )
+   {
+      if ( n != fwrite( buffer, 1, n, to ) )
+         return 0;
+   }
+   return !ferror( from );
+}
+
+static void usage( const char* name )
+{
+   fprintf( stderr,
+            "Usage: %s [-s size] [-H hop] [-m mode] [-R reactivity] [-d] [-b] [-j threads] [-o file]\n"
+            "          [-f format -c channels -r rate] input\n"
+            "  -s size        FFT size, a power of 2 from 256 to %i (default 4096)\n"
+            "  -H hop         samples between spectrums, up to the FFT size (default half the FFT size)\n"
+            "  -m mode        average, peak or frames for every spectrum (default average)\n"
+            "  -R reactivity  smoothing between spectrums like the plugin's, 1 for none (default 1)\n"
+            "  -d             magnitudes in dB instead of linear\n"
+            "  -b             binary output instead of CSV\n"
+            "  -j threads     threads to analyse with (default: one per core)\n"
+            "  -o file        write to a file instead of the standard output\n"
+            "  -f format      raw input of s16, s24, s32 or f32 little endian samples, needs -c and -r\n"
+            "  -c channels    channels of raw input\n"
+            "  -r rate        sample rate of raw input\n",
+            name, MAX_FFT );
+}
+
+int main( int argc, char** argv )
+{
+   size_t frameSize = 4096;
+   size_t hop = 0;
+   analysis_mode_t mode = MODE_AVERAGE;
+   float reactivity = 1.0f;
+   int decibels = 0;
+   int binary = 0;
+   long threads = sysconf( _SC_NPROCESSORS_ONLN );
+   const char* output = NULL;
+   const char* format = NULL;
+   int channels = 0;
+   float rate = 0;
+
+   int opt;
+   while ( -1 != (opt = getopt( argc, argv, "s:H:m:R:dbj:o:f:c:r:h" )) )
+   {
+      switch ( opt )
+      {
+      case 's':
+         frameSize = strtoul( optarg, NULL, 10 );
+         break;
+      case 'H':
+         hop = strtoul( optarg, NULL, 10 );
+         break;
+      case 'm':
+         if ( 0 == strcmp( optarg, "average" ) )
+            mode = MODE_AVERAGE;
+         else if ( 0 == strcmp( optarg, "peak" ) )
+            mode = MODE_PEAK;
+         else if ( 0 == strcmp( optarg, "frames" ) )
+            mode = MODE_FRAMES;
+         else
+            frameSize = 0;
+         break;
+      case 'R':
+         reactivity = strtof( optarg, NULL );
+         break;
+      case 'd':
+         decibels = 1;
+         break;
+      case 'b':
+         binary = 1;
+         break;
+      case 'j':
+         threads = atol( optarg );
+         break;
+      case 'o':
+         output = optarg;
+         break;
+      case 'f':
+         format = optarg;
+         break;
+      case 'c':
+         channels = atoi( optarg );
+         break;
+      case 'r':
+         rate = strtof( optarg, NULL );
+         break;
+      default:
+         usage( argv[0] );
+         return 1;
+      }
+   }
+
+   if ( 0 == hop )
+      hop = frameSize / 2;
+
+   if ( optind + 1 != argc || frameSize < 256 || frameSize > MAX_FFT || 0 != (frameSize & (frameSize - 1)) ||
+        hop > frameSize || reactivity <= 0 || reactivity > 1 || threads <= 0 )
+   {
+      usage( argv[0] );
+      return 1;
+   }
+
+   const char* input = argv[optind];
+   int fd = open( input, O_RDONLY );
+   struct stat st;
+   if ( -1 == fd || 0 != fstat( fd, &st ) )
+   {
+      fprintf( stderr, "Unable to open %s: %s\n", input, strerror( errno ) );
+      return 1;
+   }
+
+   size_t size = (size_t) st.st_size;
+   const uint8_t* map = (0 == size) ? NULL : mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+   close( fd );
+   if ( MAP_FAILED == map || NULL == map )
+   {
+      fprintf( stderr, "Unable to map %s: %s\n", input, (NULL == map) ? "empty file" : strerror( errno ) );
+      return 1;
+   }
+   /* every sample is read once, front to back */
+   madvise( (void*) map, size, MADV_SEQUENTIAL );
+
+   pcm_t pcm = { 0 };
+   int wav = (NULL == format) ? parse_wav( &pcm, map, size ) : 0;
+   if ( 0 == wav )
+   {
+      int known = NULL != format;
+      if ( known && 0 == strcmp( format, "s16" ) )
+         set_format( &pcm, 0, 16 );
+      else if ( known && 0 == strcmp( format, "s24" ) )
+         set_format( &pcm, 0, 24 );
+      else if ( known && 0 == strcmp( format, "s32" ) )
+         set_format( &pcm, 0, 32 );
+      else if ( known && 0 == strcmp( format, "f32" ) )
+         set_format( &pcm, 1, 32 );
+      else
+         known = 0;
+
+      if ( !known || channels <= 0 || rate <= 0 )
+      {
+         fprintf( stderr, "%s is no WAV file, raw input needs a format, channels and a sample rate\n", input );
+         munmap( (void*) map, size );
+         return 1;
+      }
+
+      pcm.data = map;
+      pcm.channels = channels;
+      pcm.sampleRate = rate;
+      pcm.frames = size / (pcm.width * (size_t) channels);
+   }
+
+   if ( wav < 0 || pcm.channels <= 0 || pcm.sampleRate <= 0 )
+   {
+      munmap( (void*) map, size );
+      return 1;
+   }
+
+   size_t bins = frameSize / 2 + 1;
+   size_t spectrums = (pcm.frames + hop - 1) / hop;
+   if ( 0 == spectrums )
+   {
+      fprintf( stderr, "%s has no samples\n", input );
+      munmap( (void*) map, size );
+      return 1;
+   }
+
+   size_t segments = (size_t) threads;
+   if ( segments > spectrums / MIN_SEGMENT_FRAMES )
+      segments = spectrums / MIN_SEGMENT_FRAMES;
+   if ( 0 == segments )
+      segments = 1;
+
+   /* without smoothing a spectrum only depends on its own frame, otherwise the previous ones fade out of it */
+   size_t warmup = (reactivity < 1.0f) ? (size_t) ceil( log( SMOOTHING_FORGOTTEN ) / log( 1.0 - reactivity ) ) : 0;
+
+   size_t values = (size_t) pcm.channels * bins;
+   segment_t* s = calloc( segments, sizeof( segment_t ) );
+   pthread_t* workers = calloc( segments, sizeof( pthread_t ) );
+   for ( size_t i = 0; i < segments; i++ )
+   {
+      s[i].pcm = &pcm;
+      s[i].mode = mode;
+      s[i].frameSize = frameSize;
+      s[i].hop = hop;
+      s[i].bins = bins;
+      s[i].reactivity = reactivity;
+      s[i].decibels = decibels;
+      s[i].binary = binary;
+      s[i].warmup = warmup;
+      s[i].first = spectrums * i / segments;
+      s[i].last = spectrums * (i + 1) / segments;
+      if ( MODE_AVERAGE == mode )
+         s[i].sum = calloc( values, sizeof( double ) );
+      if ( MODE_PEAK == mode )
+         s[i].peak = calloc( values, sizeof( float ) );
+   }
+
+   fprintf( stderr, "Analysing %zu samples of %i channels at %.0f Hz in %zu spectrums of %zu samples on %zu threads\n",
+            pcm.frames, pcm.channels, pcm.sampleRate, spectrums, frameSize, segments );
+
+   /* FFTW plans this size once here, the threads' plans come from the wisdom it keeps and aren't timed */
+   free_sample_data( init_sample_data( frameSize ) );
+
+   uint64_t start = perf_now();
+   for ( size_t i = 0; i < segments; i++ )
+   {
+      s[i].threaded = (0 == pthread_create( &workers[i], NULL, analyse_segment, &s[i] ));
+      /* without a thread of its own the segment is analysed here */
+      if ( !s[i].threaded )
+         analyse_segment( &s[i] );
+   }
+   for ( size_t i = 0; i < segments; i++ )
+   {
+      if ( s[i].threaded )
+         pthread_join( workers[i], NULL );
+   }
+   double took = (perf_now() - start) / 1e9;
+
+   fprintf( stderr, "Analysed in %.3f s: %.0f samples/s, %.0f sample frames/s, %.0fx real time\n",
+            took, pcm.frames * pcm.channels / took, pcm.frames / took, pcm.frames / pcm.sampleRate / took );
+
+   int result = 0;
+   for ( size_t i = 0; i < segments; i++ )
+      result |= s[i].failed;
+
+   FILE* out = (NULL == output) ? stdout : fopen( output, binary ? "wb" : "w" );
+   if ( NULL == out )
+   {
+      fprintf( stderr, "Unable to create %s: %s\n", output, strerror( errno ) );
+      result = 1;
+   }
+
+   if ( 0 == result )
+   {
+      analysis_header_t h = {
+              ANALYSIS_MAGIC,
+              ANALYSIS_VERSION,
+              (uint32_t) mode,
+              (uint32_t) pcm.channels,
+              (uint32_t) frameSize,
+              (uint32_t) hop,
+              (uint32_t) bins,
+              pcm.sampleRate,
+              (MODE_FRAMES == mode) ? spectrums : 1
+      };
+
+      if ( binary )
+         fwrite( &h, sizeof( h ), 1, out );
+      else if ( MODE_FRAMES == mode )
+      {
+         fprintf( out, "frame,time,channel" );
+         for ( size_t i = 0; i < bins; i++ )
+            fprintf( out, ",%g", i * pcm.sampleRate / frameSize );
+         fputc( '\n', out );
+      }
+      else
+      {
+         fprintf( out, "bin,frequency" );
+         for ( int c = 0; c < pcm.channels; c++ )
+            fprintf( out, ",channel%i", c );
+         fputc( '\n', out );
+      }
+
+      if ( MODE_FRAMES == mode )
+      {
+         for ( size_t i = 0; i < segments && 0 == result; i++ )
+            result = !copy_rows( s[i].rows, out );
+      }
+      else
+      {
+         /* segments are combined into the first one */
+         for ( size_t i = 1; i < segments; i++ )
+         {
+            for ( size_t v = 0; v < values; v++ )
+            {
+               if ( MODE_AVERAGE == mode )
+                  s[0].sum[v] += s[i].sum[v];
+               else
+                  s[0].peak[v] = fmaxf( s[0].peak[v], s[i].peak[v] );
+            }
+         }
+
+         float* spectrum = malloc( values * sizeof( float ) );
+         for ( size_t v = 0; v < values; v++ )
+         {
+            float m = (MODE_AVERAGE == mode) ? (float) (s[0].sum[v] / spectrums) : s[0].peak[v];
+            spectrum[v] = output_value( &s[0], m );
+         }
+
+         if ( binary )
+            fwrite( spectrum, sizeof( float ), values, out );
+         else
+         {
+            for ( size_t i = 0; i < bins; i++ )
+            {
+               fprintf( out, "%zu,%g", i, i * pcm.sampleRate / frameSize );
+               for ( int c = 0; c < pcm.channels; c++ )
+                  fprintf( out, ",%g", spectrum[(size_t) c * bins + i] );
+               fputc( '\n', out );
+            }
+         }
+         free( spectrum );
+      }
+
+      if ( 0 != fflush( out ) || ferror( out ) )
+         result = 1;
+      if ( 0 != result )
+         fprintf( stderr, "Unable to write the spectrums: %s\n", strerror( errno ) );
+   }
+
+   if ( NULL != out && stdout != out )
+      fclose( out );
+
+   for ( size_t i = 0; i < segments; i++ )
+   {
+      if ( NULL != s[i].rows )
+         fclose( s[i].rows );
+      free( s[i].sum );
+      free( s[i].peak );
+   }
+   free( workers );
+   free( s );
+   munmap( (void*) map, size );
+   return result;
+}
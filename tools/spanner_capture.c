@@ -0,0 +1,358 @@
+
+#define _GNU_SOURCE
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "spanner.h"
+#include "stream.h"
+#include "perf.h"
+
+#define CAPTURE_MAGIC 0x54505343 /* "CSPT" */
+#define CAPTURE_VERSION 1
+#define CAPTURE_GROWTH (64 << 20)
+
+/*
+ * Records the Shared Memory into a file, or replays such a file into the Shared Memory as fake instances.
+ *
+ * A capture is this header followed by the frames of `channelspanner-stream`, back to back. Every frame of
+ * one sampling shares its timestamp, and only the bins in use by each track are kept.
+ */
+typedef struct {
+   uint32_t magic;
+   uint32_t version;
+   uint32_t rate;      /* samplings per second when recorded */
+   uint32_t channels;
+   uint64_t samplings;
+   uint64_t frames;
+   uint64_t bytes;     /* bytes of frames after this header */
+} capture_header_t;
+
+static volatile sig_atomic_t running = 1;
+
+static void stop( int sig )
+{
+   (void) sig;
+   running = 0;
+}
+
+static void sleep_until( uint64_t t )
+{
+   struct timespec ts;
+   ts.tv_sec = (time_t) (t / 1000000000ull);
+   ts.tv_nsec = (long) (t % 1000000000ull);
+   while ( EINTR == clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) && running );
+}
+
+static int record( const char* path, uint32_t rate, double seconds )
+{
+   int fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+   if ( -1 == fd )
+   {
+      fprintf( stderr, "Unable to create %s: %s\n", path, strerror( errno ) );
+      return 1;
+   }
+
+   size_t size = CAPTURE_GROWTH;
+   uint8_t* map = NULL;
+   if ( 0 != ftruncate( fd, (off_t) size ) ||
+        MAP_FAILED == (map = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 )) )
+   {
+      fprintf( stderr, "Unable to map %s: %s\n", path, strerror( errno ) );
+      close( fd );
+      return 1;
+   }
+
+   capture_header_t* h = (capture_header_t*) map;
+   memset( h, 0, sizeof( *h ) );
+   h->magic = CAPTURE_MAGIC;
+   h->version = CAPTURE_VERSION;
+   h->rate = rate;
+   h->channels = MAX_CHANNELS;
+
+   shared_memory_t* shmem = open_shared_memory_reader();
+
+   fprintf( stderr, "Recording Shared Memory into %s at %u Hz\n", path, rate );
+
+   uint64_t interval = 1000000000ull / rate;
+   uint64_t start = perf_now();
+   uint64_t end = (seconds > 0) ? start + (uint64_t) (seconds * 1e9) : UINT64_MAX;
+
+   for ( uint64_t next = start; running && next < end; next += interval )
+   {
+      sleep_until( next );
+
+      uint64_t timestamp = perf_now();
+      uint64_t frames = h->frames;
+
+      for ( int g = 0; g <= MAX_INSTANCES; g++ )
+      {
+         for ( int s = next_group_member( shmem, (uint8_t) g, -1 ); -1 != s; s = next_group_member( shmem, (uint8_t) g, s ) )
+         {
+            size_t used = sizeof( capture_header_t ) + h->bytes;
+            if ( used + STREAM_FRAME_MAX > size )
+            {
+               size_t grown = size + CAPTURE_GROWTH;
+               uint8_t* remapped;
+               if ( 0 != ftruncate( fd, (off_t) grown ) ||
+                    MAP_FAILED == (remapped = mremap( map, size, grown, MREMAP_MAYMOVE )) )
+               {
+                  fprintf( stderr, "Unable to grow %s: %s\n", path, strerror( errno ) );
+                  running = 0;
+                  break;
+               }
+               map = remapped;
+               size = grown;
+               h = (capture_header_t*) map;
+            }
+
+            size_t len = pack_stream_frame( map + used, shmem, s, (uint8_t) g, timestamp );
+            h->bytes += len;
+            h->frames += (len > 0);
+         }
+      }
+
+      if ( h->frames != frames )
+         h->samplings++;
+   }
+
+   fprintf( stderr, "Recorded %lu samplings, %lu frames, %lu bytes\n",
+            (unsigned long) h->samplings, (unsigned long) h->frames, (unsigned long) h->bytes );
+
+   size_t used = sizeof( capture_header_t ) + h->bytes;
+   munmap( map, size );
+   if ( 0 != ftruncate( fd, (off_t) used ) )
+      fprintf( stderr, "Unable to trim %s: %s\n", path, strerror( errno ) );
+   close( fd );
+   close_shared_memory( shmem );
+   return 0;
+}
+
+typedef struct {
+   int64_t id;       /* recorded track this instance plays */
+   shared_memory_t* shmem;
+   track_t* track;
+} fake_instance_t;
+
+/* reads the frame at `p`, returns where the next one starts, or NULL when this one runs past `last` or is not one
+   this build can replay */
+static const uint8_t* read_frame( const uint8_t* p, const uint8_t* last, stream_frame_t* f, const float** fft )
+{
+   uint32_t length;
+   size_t left = (size_t) (last - p);
+   if ( left < sizeof( length ) + sizeof( *f ) ) return NULL;
+
+   memcpy( &length, p, sizeof( length ) );
+   memcpy( f, p + sizeof( length ), sizeof( *f ) );
+
+   if ( STREAM_MAGIC != f->magic || f->bins > MAX_FFT / 2 + 1 || f->frameSize < 2 || f->frameSize > MAX_FFT ||
+        f->group < 1 || f->group > MAX_INSTANCES )
+      return NULL;
+
+   if ( length < sizeof( *f ) + (size_t) MAX_CHANNELS * f->bins * sizeof( float ) ||
+        length > left - sizeof( length ) )
+      return NULL;
+
+   *fft = (const float*) (p + sizeof( length ) + sizeof( *f ));
+   return p + sizeof( length ) + length;
+}
+
+static int replay( const char* path, double speed, int instances, int loop )
+{
+   int fd = open( path, O_RDONLY );
+   struct stat st;
+   if ( -1 == fd || 0 != fstat( fd, &st ) || st.st_size < (off_t) sizeof( capture_header_t ) )
+   {
+      fprintf( stderr, "Unable to open %s: %s\n", path, strerror( errno ) );
+      return 1;
+   }
+
+   const uint8_t* map = mmap( NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+   close( fd );
+   if ( MAP_FAILED == map )
+   {
+      fprintf( stderr, "Unable to map %s: %s\n", path, strerror( errno ) );
+      return 1;
+   }
+
+   const capture_header_t* h = (const capture_header_t*) map;
+   if ( CAPTURE_MAGIC != h->magic || CAPTURE_VERSION != h->version || MAX_CHANNELS != h->channels ||
+        h->bytes > (uint64_t) st.st_size - sizeof( capture_header_t ) )
+   {
+      fprintf( stderr, "%s is not a capture for this build\n", path );
+      munmap( (void*) map, (size_t) st.st_size );
+      return 1;
+   }
+
+   const uint8_t* first = map + sizeof( capture_header_t );
+   const uint8_t* last = first + h->bytes;
+
+   /* every recorded track gets an instance, further instances repeat them */
+   int64_t ids[MAX_SLOTS];
+   int tracks = 0;
+   /* the replay stops where the frames do, a capture cut short or damaged past there plays up to it */
+   const uint8_t* end = first;
+   for ( const uint8_t* p = first; p < last; )
+   {
+      stream_frame_t f;
+      const float* fft;
+      if ( NULL == (p = read_frame( p, last, &f, &fft )) ) break;
+      end = p;
+      if ( tracks == MAX_SLOTS ) continue;
+
+      int known = 0;
+      for ( int i = 0; i < tracks && !known; i++ )
+         known = (ids[i] == f.id);
+      if ( !known )
+         ids[tracks++] = f.id;
+   }
+
+   if ( end < last )
+      fprintf( stderr, "%s is damaged after %zu bytes of frames, replaying up to there\n", path,
+               (size_t) (end - first) );
+
+   if ( 0 == tracks )
+   {
+      fprintf( stderr, "%s has no frames\n", path );
+      munmap( (void*) map, (size_t) st.st_size );
+      return 1;
+   }
+
+   if ( instances <= 0 )
+      instances = tracks;
+
+   fake_instance_t* fakes = calloc( (size_t) instances, sizeof( fake_instance_t ) );
+   for ( int i = 0; i < instances; i++ )
+   {
+      fakes[i].id = ids[i % tracks];
+      fakes[i].shmem = open_shared_memory();
+      fakes[i].track = calloc( 1, sizeof( track_t ) );
+   }
+
+   fprintf( stderr, "Replaying %s at %.2fx as %i instances of %i tracks\n", path, speed, instances, tracks );
+
+   do
+   {
+      uint64_t start = perf_now();
+      uint64_t base = 0;
+      uint64_t current = 0;
+
+      for ( const uint8_t* p = first; running && p < end; )
+      {
+         stream_frame_t f;
+         const float* fft;
+         p = read_frame( p, end, &f, &fft );
+
+         /* frames of one sampling go out together, at the recorded pace */
+         if ( 0 == base ) base = f.timestamp;
+         if ( f.timestamp != current )
+         {
+            current = f.timestamp;
+            sleep_until( start + (uint64_t) ((current - base) / speed) );
+         }
+
+         for ( int i = 0; i < instances; i++ )
+         {
+            if ( fakes[i].id != f.id ) continue;
+
+            track_t* t = fakes[i].track;
+            t->frameSize = f.frameSize;
+            t->sampleRate = (float) f.sampleRate;
+            t->color = f.color;
+            t->group = f.group;
+            for ( int c = 0; c < MAX_CHANNELS; c++ )
+               memcpy( t->channels[c].fft, fft + c * f.bins, f.bins * sizeof( float ) );
+
+            update_shared_memory( fakes[i].shmem, t );
+         }
+      }
+   } while ( running && loop );
+
+   for ( int i = 0; i < instances; i++ )
+   {
+      close_shared_memory( fakes[i].shmem );
+      free( fakes[i].track );
+   }
+   free( fakes );
+   munmap( (void*) map, (size_t) st.st_size );
+   return 0;
+}
+
+static void usage( const char* name )
+{
+   fprintf( stderr,
+            "Usage: %s -o file [-r rate] [-t seconds]\n"
+            "       %s -i file [-x speed] [-n instances] [-l]\n"
+            "  -o file       record the Shared Memory into a capture\n"
+            "  -r rate       samplings per second while recording (default 60)\n"
+            "  -t seconds    stop recording after this long (default: until interrupted)\n"
+            "  -i file       replay a capture into the Shared Memory\n"
+            "  -x speed      replay speed, 2 plays twice as fast (default 1)\n"
+            "  -n instances  fake instances to replay as, tracks repeat when there are more (default: one per track)\n"
+            "  -l            loop the replay until interrupted\n",
+            name, name );
+}
+
+int main( int argc, char** argv )
+{
+   const char* output = NULL;
+   const char* input = NULL;
+   uint32_t rate = 60;
+   double seconds = 0;
+   double speed = 1.0;
+   int instances = 0;
+   int loop = 0;
+
+   int opt;
+   while ( -1 != (opt = getopt( argc, argv, "o:r:t:i:x:n:lh" )) )
+   {
+      switch ( opt )
+      {
+      case 'o':
+         output = optarg;
+         break;
+      case 'r':
+         rate = (uint32_t) strtoul( optarg, NULL, 10 );
+         break;
+      case 't':
+         seconds = strtod( optarg, NULL );
+         break;
+      case 'i':
+         input = optarg;
+         break;
+      case 'x':
+         speed = strtod( optarg, NULL );
+         break;
+      case 'n':
+         instances = atoi( optarg );
+         break;
+      case 'l':
+         loop = 1;
+         break;
+      default:
+         usage( argv[0] );
+         return 1;
+      }
+   }
+
+   if ( (NULL == output) == (NULL == input) || 0 == rate || speed <= 0 )
+   {
+      usage( argv[0] );
+      return 1;
+   }
+
+   signal( SIGINT, stop );
+   signal( SIGTERM, stop );
+
+   if ( NULL != output )
+      return record( output, rate, seconds );
+   return replay( input, speed, instances, loop );
+}
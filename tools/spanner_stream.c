@@ -0,0 +1,312 @@
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#include "spanner.h"
+#include "stream.h"
+#include "perf.h"
+
+#define MAX_CLIENTS 16
+
+/*
+ * Streams the shared spectrums of every instance to local clients.
+ *
+ * This runs as its own process and only reads the Shared Memory, so nothing here can hold up an audio thread.
+ * Each sampling of the Shared Memory becomes one reference counted batch of frames. Clients queue batches,
+ * and when a client falls behind its oldest queued batches are dropped instead of the server waiting for it.
+ */
+
+typedef struct {
+   size_t refs;
+   size_t len;
+   uint8_t data[];
+} batch_t;
+
+typedef struct {
+   int fd;
+   uint32_t rate;       /* batches per second this client wants */
+   uint64_t due;        /* when this client takes its next batch */
+   size_t head;         /* offset into the batch being written */
+   size_t queued;
+   batch_t** queue;     /* ring of queued batches, oldest at `first` */
+   size_t first;
+   uint64_t sent;
+   uint64_t dropped;
+} client_t;
+
+static volatile sig_atomic_t running = 1;
+
+static void stop( int sig )
+{
+   (void) sig;
+   running = 0;
+}
+
+static void release_batch( batch_t* b )
+{
+   if ( NULL != b && 0 == --b->refs )
+      free( b );
+}
+
+/* copy every live track into one batch of frames */
+static batch_t* sample_shared_memory( shared_memory_t* shmem )
+{
+   size_t count = 0;
+
+   for ( int g = 0; g <= MAX_INSTANCES; g++ )
+      for ( int s = next_group_member( shmem, (uint8_t) g, -1 ); -1 != s; s = next_group_member( shmem, (uint8_t) g, s ) )
+         count++;
+
+   batch_t* b = malloc( sizeof( batch_t ) + count * STREAM_FRAME_MAX );
+   if ( NULL == b ) return NULL;
+   b->refs = 1;
+   b->len = 0;
+
+   uint64_t timestamp = perf_now();
+
+   for ( int g = 0; g <= MAX_INSTANCES; g++ )
+   {
+      for ( int s = next_group_member( shmem, (uint8_t) g, -1 ); -1 != s && count > 0; s = next_group_member( shmem, (uint8_t) g, s ) )
+      {
+         size_t len = pack_stream_frame( &b->data[b->len], shmem, s, (uint8_t) g, timestamp );
+         if ( 0 == len ) continue;
+         b->len += len;
+         count--;
+      }
+   }
+
+   return b;
+}
+
+static void queue_batch( client_t* c, batch_t* b, size_t depth )
+{
+   if ( c->queued == depth )
+   {
+      /* drop the oldest batch that has not started sending, a partly sent batch has to finish */
+      size_t drop = (0 == c->head) ? c->first : (c->first + 1) % depth;
+      release_batch( c->queue[drop] );
+      if ( drop != c->first )
+         c->queue[drop] = c->queue[c->first];
+      c->first = (c->first + 1) % depth;
+      c->queued--;
+      c->dropped++;
+   }
+
+   b->refs++;
+   c->queue[(c->first + c->queued) % depth] = b;
+   c->queued++;
+}
+
+static void close_client( client_t* c, size_t depth )
+{
+   fprintf( stderr, "Client %i left: %lu batches sent, %lu dropped\n", c->fd, (unsigned long) c->sent, (unsigned long) c->dropped );
+   close( c->fd );
+   c->fd = -1;
+   while ( c->queued > 0 )
+   {
+      release_batch( c->queue[c->first] );
+      c->first = (c->first + 1) % depth;
+      c->queued--;
+   }
+   c->first = 0;
+   c->head = 0;
+}
+
+/* write as much as the socket takes without blocking, returns -1 when the client is gone */
+static int flush_client( client_t* c, size_t depth )
+{
+   while ( c->queued > 0 )
+   {
+      batch_t* b = c->queue[c->first];
+      ssize_t n = send( c->fd, b->data + c->head, b->len - c->head, MSG_NOSIGNAL | MSG_DONTWAIT );
+      if ( n < 0 )
+         return (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) ? 0 : -1;
+
+      c->head += (size_t) n;
+      if ( c->head == b->len )
+      {
+         release_batch( b );
+         c->first = (c->first + 1) % depth;
+         c->queued--;
+         c->head = 0;
+         c->sent++;
+      }
+   }
+   return 0;
+}
+
+static void usage( const char* name )
+{
+   fprintf( stderr,
+            "Usage: %s [-p socket] [-r rate] [-d depth]\n"
+            "  -p socket  Unix domain socket to listen on (default " STREAM_SOCKET ")\n"
+            "  -r rate    samplings of the Shared Memory per second, and the most a client gets (default 60)\n"
+            "  -d depth   batches queued per client before the oldest is dropped (default 4)\n",
+            name );
+}
+
+int main( int argc, char** argv )
+{
+   const char* path = STREAM_SOCKET;
+   uint32_t rate = 60;
+   size_t depth = 4;
+
+   int opt;
+   while ( -1 != (opt = getopt( argc, argv, "p:r:d:h" )) )
+   {
+      switch ( opt )
+      {
+      case 'p':
+         path = optarg;
+         break;
+      case 'r':
+         rate = (uint32_t) strtoul( optarg, NULL, 10 );
+         break;
+      case 'd':
+         depth = strtoul( optarg, NULL, 10 );
+         break;
+      default:
+         usage( argv[0] );
+         return 1;
+      }
+   }
+
+   if ( 0 == rate || 0 == depth )
+   {
+      usage( argv[0] );
+      return 1;
+   }
+
+   signal( SIGINT, stop );
+   signal( SIGTERM, stop );
+
+   struct sockaddr_un addr;
+   memset( &addr, 0, sizeof( addr ) );
+   addr.sun_family = AF_UNIX;
+   strncpy( addr.sun_path, path, sizeof( addr.sun_path ) - 1 );
+
+   int server = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+   unlink( path );
+   if ( -1 == server || 0 != bind( server, (struct sockaddr*) &addr, sizeof( addr ) ) || 0 != listen( server, MAX_CLIENTS ) )
+   {
+      fprintf( stderr, "Unable to listen on %s: %s\n", path, strerror( errno ) );
+      return 1;
+   }
+
+   shared_memory_t* shmem = open_shared_memory_reader();
+
+   client_t clients[MAX_CLIENTS];
+   memset( clients, 0, sizeof( clients ) );
+   for ( int i = 0; i < MAX_CLIENTS; i++ )
+   {
+      clients[i].fd = -1;
+      clients[i].queue = calloc( depth, sizeof( batch_t* ) );
+   }
+
+   fprintf( stderr, "Streaming Shared Memory on %s at %u Hz\n", path, rate );
+
+   uint64_t interval = 1000000000ull / rate;
+   uint64_t next = perf_now();
+
+   while ( running )
+   {
+      struct pollfd fds[MAX_CLIENTS + 1];
+      fds[0].fd = server;
+      fds[0].events = POLLIN;
+      for ( int i = 0; i < MAX_CLIENTS; i++ )
+      {
+         fds[i + 1].fd = clients[i].fd;
+         fds[i + 1].events = POLLIN | (clients[i].queued > 0 ? POLLOUT : 0);
+         fds[i + 1].revents = 0;
+      }
+
+      uint64_t now = perf_now();
+      int timeout = (next > now) ? (int) ((next - now) / 1000000) : 0;
+      if ( poll( fds, MAX_CLIENTS + 1, timeout ) < 0 && EINTR != errno )
+         break;
+
+      if ( fds[0].revents & POLLIN )
+      {
+         int fd = accept( server, NULL, NULL );
+         if ( -1 != fd )
+            fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+         int placed = 0;
+         for ( int i = 0; -1 != fd && i < MAX_CLIENTS && !placed; i++ )
+         {
+            if ( -1 != clients[i].fd ) continue;
+            clients[i].fd = fd;
+            clients[i].rate = rate;
+            clients[i].due = 0;
+            clients[i].sent = 0;
+            clients[i].dropped = 0;
+            placed = 1;
+            fprintf( stderr, "Client %i joined\n", fd );
+         }
+         if ( -1 != fd && !placed )
+            close( fd );
+      }
+
+      for ( int i = 0; i < MAX_CLIENTS; i++ )
+      {
+         client_t* c = &clients[i];
+         if ( -1 == c->fd ) continue;
+
+         if ( fds[i + 1].revents & POLLIN )
+         {
+            uint32_t wanted;
+            ssize_t n = recv( c->fd, &wanted, sizeof( wanted ), MSG_DONTWAIT );
+            if ( 0 == n || (n < 0 && EAGAIN != errno && EINTR != errno) )
+            {
+               close_client( c, depth );
+               continue;
+            }
+            if ( n == sizeof( wanted ) && wanted > 0 )
+               c->rate = (wanted < rate) ? wanted : rate;
+         }
+
+         if ( (fds[i + 1].revents & (POLLOUT | POLLERR | POLLHUP)) && 0 != flush_client( c, depth ) )
+            close_client( c, depth );
+      }
+
+      now = perf_now();
+      if ( now < next ) continue;
+      next += interval;
+      if ( next < now ) next = now + interval;
+
+      batch_t* b = NULL;
+      for ( int i = 0; i < MAX_CLIENTS; i++ )
+      {
+         client_t* c = &clients[i];
+         if ( -1 == c->fd || now < c->due ) continue;
+         c->due = now + 1000000000ull / c->rate - interval / 2;
+
+         if ( NULL == b ) b = sample_shared_memory( shmem );
+         if ( NULL == b || 0 == b->len ) break;
+         queue_batch( c, b, depth );
+         if ( 0 != flush_client( c, depth ) )
+            close_client( c, depth );
+      }
+      release_batch( b );
+   }
+
+   for ( int i = 0; i < MAX_CLIENTS; i++ )
+   {
+      if ( -1 != clients[i].fd )
+         close_client( &clients[i], depth );
+      free( clients[i].queue );
+   }
+
+   close( server );
+   unlink( path );
+   close_shared_memory( shmem );
+   return 0;
+}
@@ -0,0 +1,36 @@
+#include <string.h>
+
+#include "spanner.h"
+#include "stream.h"
+
+/* write one slot as a length-prefixed frame, returns the bytes written or 0 if the slot is not live */
+size_t pack_stream_frame( uint8_t* dst, shared_memory_t* shmem, int slot, uint8_t group, uint64_t timestamp )
+{
+   spanned_slot_t* meta = get_shared_memory_slot( shmem, slot );
+   spanned_track_t* track = get_shared_memory_track( shmem, slot );
+   if ( NULL == meta || NULL == track ) return 0;
+
+   stream_frame_t f;
+   memset( &f, 0, sizeof( f ) );
+   f.magic = STREAM_MAGIC;
+   f.slot = (uint32_t) slot;
+   f.timestamp = timestamp;
+   f.id = __atomic_load_n( &meta->id, __ATOMIC_ACQUIRE );
+   f.frameSize = __atomic_load_n( &meta->frameSize, __ATOMIC_ACQUIRE );
+   f.sampleRate = __atomic_load_n( &meta->sampleRate, __ATOMIC_RELAXED );
+   f.color = __atomic_load_n( &meta->color, __ATOMIC_RELAXED );
+   f.group = group;
+   f.channels = MAX_CHANNELS;
+   if ( 0 == f.id || 0 == f.frameSize || f.frameSize > MAX_FFT ) return 0;
+   f.bins = f.frameSize / 2 + 1;
+
+   uint32_t length = (uint32_t) (sizeof( f ) + MAX_CHANNELS * f.bins * sizeof( float ));
+   memcpy( dst, &length, sizeof( length ) );
+   dst += sizeof( length );
+   memcpy( dst, &f, sizeof( f ) );
+   dst += sizeof( f );
+   for ( int c = 0; c < MAX_CHANNELS; c++, dst += f.bins * sizeof( float ) )
+      memcpy( dst, track->fft[c], f.bins * sizeof( float ) );
+
+   return sizeof( length ) + length;
+}
@@ -0,0 +1,49 @@
+#ifndef CHANNELSPANNER_STREAM_H
+#define CHANNELSPANNER_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STREAM_SOCKET "/tmp/ChannelSpanner.sock"
+#define STREAM_MAGIC 0x4e505343 /* "CSPN" */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Every frame is one shared track at one point in time, and frames are sent back to back:
+ *
+ *    uint32_t length                    bytes following this field
+ *    stream_frame_t header
+ *    float fft[channels][bins]          linear magnitudes, bin i is at i * sampleRate / frameSize
+ *
+ * Everything is in host byte order, as the socket is local.
+ * A client may send a single uint32_t at any time to request a rate in frames per second per track.
+ */
+typedef struct {
+   uint32_t magic;
+   uint32_t slot;
+   uint64_t timestamp; /* CLOCK_MONOTONIC nanoseconds when the server sampled the track */
+   int64_t id;
+   uint32_t frameSize;
+   uint32_t sampleRate;
+   uint32_t bins;
+   uint8_t color;
+   uint8_t group;
+   uint8_t channels;
+   uint8_t reserved;
+} stream_frame_t;
+
+/* the most a single frame takes, including its length */
+#define STREAM_FRAME_MAX (sizeof( uint32_t ) + sizeof( stream_frame_t ) + MAX_CHANNELS * (MAX_FFT / 2 + 1) * sizeof( float ))
+
+struct shared_memory_t;
+
+size_t pack_stream_frame( uint8_t* dst, struct shared_memory_t* shmem, int slot, uint8_t group, uint64_t timestamp );
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CHANNELSPANNER_STREAM_H
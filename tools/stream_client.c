@@ -0,0 +1,189 @@
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "stream.h"
+#include "perf.h"
+
+/*
+ * Connects to the spectrum stream and reports throughput and the latency from sampling to receiving.
+ * A delay per frame simulates a slow consumer, to watch the server drop batches instead of falling behind.
+ */
+
+static int read_all( int fd, void* buf, size_t len )
+{
+   uint8_t* p = buf;
+   while ( len > 0 )
+   {
+      ssize_t n = recv( fd, p, len, 0 );
+      if ( n < 0 && EINTR == errno ) continue;
+      if ( n <= 0 ) return -1;
+      p += n;
+      len -= (size_t) n;
+   }
+   return 0;
+}
+
+static int compare( const void* a, const void* b )
+{
+   uint64_t x = *(const uint64_t*) a;
+   uint64_t y = *(const uint64_t*) b;
+   return (x > y) - (x < y);
+}
+
+static void usage( const char* name )
+{
+   fprintf( stderr,
+            "Usage: %s [-p socket] [-r rate] [-t seconds] [-s delay]\n"
+            "  -p socket   Unix domain socket to connect to (default " STREAM_SOCKET ")\n"
+            "  -r rate     batches per second to ask for (default: the server's rate)\n"
+            "  -t seconds  how long to measure (default 10)\n"
+            "  -s delay    microseconds to stall after every frame, to act as a slow client (default 0)\n",
+            name );
+}
+
+int main( int argc, char** argv )
+{
+   const char* path = STREAM_SOCKET;
+   uint32_t rate = 0;
+   double seconds = 10.0;
+   useconds_t delay = 0;
+
+   int opt;
+   while ( -1 != (opt = getopt( argc, argv, "p:r:t:s:h" )) )
+   {
+      switch ( opt )
+      {
+      case 'p':
+         path = optarg;
+         break;
+      case 'r':
+         rate = (uint32_t) strtoul( optarg, NULL, 10 );
+         break;
+      case 't':
+         seconds = strtod( optarg, NULL );
+         break;
+      case 's':
+         delay = (useconds_t) strtoul( optarg, NULL, 10 );
+         break;
+      default:
+         usage( argv[0] );
+         return 1;
+      }
+   }
+
+   struct sockaddr_un addr;
+   memset( &addr, 0, sizeof( addr ) );
+   addr.sun_family = AF_UNIX;
+   strncpy( addr.sun_path, path, sizeof( addr.sun_path ) - 1 );
+
+   int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+   if ( -1 == fd || 0 != connect( fd, (struct sockaddr*) &addr, sizeof( addr ) ) )
+   {
+      fprintf( stderr, "Unable to connect to %s: %s\n", path, strerror( errno ) );
+      return 1;
+   }
+
+   if ( rate > 0 && sizeof( rate ) != send( fd, &rate, sizeof( rate ), MSG_NOSIGNAL ) )
+      fprintf( stderr, "Unable to request a rate of %u\n", rate );
+
+   size_t capacity = 1 << 20;
+   uint8_t* payload = malloc( capacity );
+
+   size_t latencyCap = 1 << 16;
+   size_t latencyCount = 0;
+   uint64_t* latencies = malloc( latencyCap * sizeof( uint64_t ) );
+
+   uint64_t frames = 0;
+   uint64_t bytes = 0;
+   uint64_t batches = 0;
+   uint64_t lastTimestamp = 0;
+
+   uint64_t start = perf_now();
+   uint64_t end = start + (uint64_t) (seconds * 1e9);
+
+   while ( perf_now() < end )
+   {
+      uint32_t length;
+      if ( 0 != read_all( fd, &length, sizeof( length ) ) )
+      {
+         fprintf( stderr, "Stream closed\n" );
+         break;
+      }
+
+      if ( length < sizeof( stream_frame_t ) )
+      {
+         fprintf( stderr, "Bad frame length %u\n", length );
+         break;
+      }
+
+      if ( length > capacity )
+      {
+         capacity = length;
+         payload = realloc( payload, capacity );
+      }
+
+      if ( 0 != read_all( fd, payload, length ) )
+      {
+         fprintf( stderr, "Stream closed mid-frame\n" );
+         break;
+      }
+
+      uint64_t received = perf_now();
+
+      stream_frame_t f;
+      memcpy( &f, payload, sizeof( f ) );
+      if ( STREAM_MAGIC != f.magic || length != sizeof( f ) + f.channels * f.bins * sizeof( float ) )
+      {
+         fprintf( stderr, "Bad frame: magic %08x, %u bytes for %u x %u bins\n", f.magic, length, f.channels, f.bins );
+         break;
+      }
+
+      frames++;
+      bytes += sizeof( length ) + length;
+
+      /* every frame of one batch shares the sampling time */
+      if ( f.timestamp != lastTimestamp )
+      {
+         lastTimestamp = f.timestamp;
+         batches++;
+
+         if ( latencyCount == latencyCap )
+         {
+            latencyCap *= 2;
+            latencies = realloc( latencies, latencyCap * sizeof( uint64_t ) );
+         }
+         latencies[latencyCount++] = received - f.timestamp;
+      }
+
+      if ( delay > 0 )
+         usleep( delay );
+   }
+
+   double elapsed = (perf_now() - start) / 1e9;
+   close( fd );
+
+   printf( "elapsed_s,frames,batches,frames_per_s,batches_per_s,mb_per_s,latency_p50_us,latency_p99_us,latency_max_us\n" );
+   if ( latencyCount > 0 )
+   {
+      qsort( latencies, latencyCount, sizeof( uint64_t ), compare );
+      printf( "%.3f,%lu,%lu,%.1f,%.1f,%.3f,%.1f,%.1f,%.1f\n",
+              elapsed, (unsigned long) frames, (unsigned long) batches,
+              frames / elapsed, batches / elapsed, bytes / elapsed / 1e6,
+              latencies[latencyCount / 2] / 1e3,
+              latencies[latencyCount * 99 / 100] / 1e3,
+              latencies[latencyCount - 1] / 1e3 );
+   }
+   else
+      printf( "%.3f,0,0,0,0,0,0,0,0\n", elapsed );
+
+   free( latencies );
+   free( payload );
+   return 0;
+}